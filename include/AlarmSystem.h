@@ -1,7 +1,9 @@
 #pragma once
 #include "Config.h"
 #include "Timekeeper.h"
-#include <DFRobotDFPlayerMini.h>
+#include "TrackCatalog.h"
+#include "AudioPlayer.h"
+#include <Preferences.h>
 #include <RTClib.h>
 #include <functional>
 #include <stdint.h>
@@ -9,29 +11,109 @@
 // AlarmSystem.h
 // Central alarm control system
 
+// One step of the ringing escalation table. While ringing, the active stage plays a track
+// from its category (track 0 = next from the category's shuffled playlist, or a random pick
+// in RANDOM mode), raises the volume by rampPerMin steps every minute, and moves to
+// the next stage after durationSec (0 = stay in this stage until dismissed).
+struct EscalationStage
+{
+    uint8_t category; // TrackConfig category (card folder)
+    uint8_t track;    // Track in category, 0 = pick by mode
+    uint8_t mode;     // TrackConfig::SHUFFLE or TrackConfig::RANDOM
+    uint8_t startVol;
+    uint8_t rampPerMin;
+    uint16_t durationSec;
+    uint8_t next;
+};
+
+namespace AlarmConfig
+{
+constexpr uint8_t MAX_ALARMS = 8;    // Alarm table capacity
+constexpr uint8_t TABLE_VERSION = 2; // Saved AlarmTime layout, bump when it changes (1: no stage)
+
+// Day masks (bit 0 = Sunday ... bit 6 = Saturday, same order as DateTime::dayOfTheWeek())
+constexpr uint8_t ONE_SHOT = 0x00;  // No repeat days: rings once at the next matching time, then disables
+constexpr uint8_t EVERY_DAY = 0x7F; // Rings every day
+constexpr uint8_t WEEKDAYS = 0x3E;  // Monday - Friday
+constexpr uint8_t WEEKENDS = 0x41;  // Saturday + Sunday
+
+constexpr uint16_t MINUTES_PER_DAY = 24 * 60;
+constexpr uint16_t MINUTES_PER_WEEK = 7 * MINUTES_PER_DAY;
+constexpr uint16_t NO_SLOT = 0xFFFF; // DS3231 alarm slot is not programmed
+
+// Alarm task
+constexpr uint32_t FALLBACK_POLL_MS = 30000; // Flag poll in case an INT edge is missed
+constexpr uint32_t NOTIFY_RTC_INT = 1 << 0;   // DS3231 INT pin went low
+constexpr uint32_t NOTIFY_RESCHEDULE = 1 << 1; // Reprogram hardware alarms
+constexpr uint32_t NOTIFY_STAGE = 1 << 2;      // Escalation stage duration expired
+constexpr uint32_t NOTIFY_RAMP = 1 << 3;       // Escalation volume ramp step
+constexpr uint32_t NOTIFY_DISMISS = 1 << 4;    // Stop escalation and playback
+constexpr uint32_t NOTIFY_TRACK_DONE = 1 << 5; // Player finished the current track
+
+// Escalation
+constexpr uint8_t MAX_STAGES = 8;
+constexpr uint8_t VOLUME_CEILING = 25; // Ramps never go past this (speaker safety, see PLAYER_VOLUME)
+constexpr uint32_t MIN_RAMP_STEP_MS = 1000; // Fastest volume step rate, keeps ramps off the DFPlayer UART
+
+// Wake ramp: playback starts this many minutes early and rises to the stage volume by the alarm time
+constexpr uint8_t MAX_WAKE_RAMP_MIN = 30;
+constexpr uint8_t DEFAULT_WAKE_RAMP_MIN = 0; // 0 = ring at full stage volume on time
+constexpr uint8_t WAKE_START_VOL = 1;
+
+// Default table: stage 0 reproduces the original behaviour (normal song, then a loud song every 5 min)
+constexpr EscalationStage DEFAULT_STAGES[] = {
+    {TrackConfig::NORMAL_SONGS, 0, TrackConfig::SHUFFLE, PLAYER_VOLUME, 0, 300, 1}, // 0: normal wakeup
+    {TrackConfig::LOUD_SONGS, 0, TrackConfig::SHUFFLE, VOLUME_CEILING, 0, 300, 1},  // 1: loud, repeats
+    {TrackConfig::BUZZERS, 0, TrackConfig::SHUFFLE, 10, 6, 120, 1},                 // 2: buzzer ramp
+};
+} // namespace AlarmConfig
+
 struct AlarmTime
 {
     uint8_t hour;
     uint8_t minute;
     bool enabled;
+    uint8_t days;  // Repeat day mask (AlarmConfig::ONE_SHOT for a single ring)
+    bool skipNext; // Next occurrence is silently consumed
+    uint8_t stage; // Escalation stage entered when this alarm rings
 };
 
 class AlarmSystem
 {
   public:
-    AlarmSystem(RTC_DS3231 &rtc, Timekeeper &tk, DFRobotDFPlayerMini &player);
+    AlarmSystem(RTC_DS3231 &rtc, Timekeeper &tk, AudioPlayer &player, TrackCatalog &tracks);
 
     void begin();
 
     void run();
 
+    // Primary alarm (index 0), used by the button controls
     AlarmTime getAlarm();
     void setAlarm(uint8_t hr, uint8_t min, bool enable);
 
+    // Alarm table access
+    uint8_t alarmCount();
+    bool getAlarm(uint8_t idx, AlarmTime &out);
+    bool setAlarm(uint8_t idx, const AlarmTime &alarm);
+    int addAlarm(const AlarmTime &alarm);
+    bool removeAlarm(uint8_t idx);
+    bool skipNext(uint8_t idx, bool skip = true);
+
+    // Escalation table access
+    bool getStage(uint8_t idx, EscalationStage &out);
+    bool setStage(uint8_t idx, const EscalationStage &stage);
+
+    // Wake ramp window (minutes before each alarm) and whether the backlight ramps along.
+    // Stored in SETTINGS (Setting::WakeRampMin / WakeRampSync).
+    void setWakeRamp(uint8_t minutes, bool syncBacklight);
+    uint8_t getWakeRamp(bool &syncBacklight);
+
+    // Next upcoming alarm occurrence (false if nothing is scheduled)
+    bool getNextAlarm(AlarmTime &out, DateTime &when);
+
     void dismissAlarm();
 
     bool isRinging();
-    bool isAlarmTime();
 
     //========== Callbacks ==========
     using Callback = std::function<void()>;
@@ -39,28 +121,80 @@ class AlarmSystem
     // (e.g., alarm changes or alarm triggers)
     void onAlarmEvent(Callback cb) { _onAlarmEvent = cb; };
 
-    //========== Alarm config ==========
-    // Track range for alarm sounds
-    std::pair<uint8_t, uint8_t> trackRange = Tracks::normalSongs;
-    // Alarm volume
-    uint8_t normalVol = PLAYER_VOLUME;
-    // TODO: add customization for snooze alarm (profile, time until going off, volume)
+    using RampCallback = std::function<void(uint32_t durationMs)>;
+    // Registers a callback when a wake ramp starts with backlight sync enabled
+    void onWakeRamp(RampCallback cb) { _onWakeRamp = cb; };
 
   private:
+    // One occurrence of an alarm within the week, sorted by minuteOfWeek
+    struct ScheduleEntry
+    {
+        uint16_t minuteOfWeek;
+        uint8_t alarm; // index into _alarms
+    };
+
     RTC_DS3231 &_rtc;
     Timekeeper &_tk;
-    DFRobotDFPlayerMini &_player;
+    AudioPlayer &_player;
+    TrackCatalog &_tracks;
+
+    volatile bool _ringing;
+    volatile bool _eventPending;         // Set by the alarm task, delivered to _onAlarmEvent from run()
+    volatile uint32_t _wakeRampPendingMs; // Set by the alarm task, delivered to _onWakeRamp from run()
 
-    bool _ringing;
-    AlarmTime _alarm;
+    // Alarm table and its compiled weekly schedule
+    AlarmTime _alarms[AlarmConfig::MAX_ALARMS];
+    uint8_t _alarmCount;
+    ScheduleEntry _schedule[AlarmConfig::MAX_ALARMS * 7];
+    uint8_t _scheduleSize;
+
+    // Alarm minute of week served by DS3231 alarm 1 and alarm 2 (the hardware fires up to
+    // the wake ramp window earlier)
+    uint16_t _slotMinute[2];
+    uint16_t _consumedMinute; // Last occurrence handled, may still be ahead of now while ramping
+
+    // Escalation table and ringing state (owned by the alarm task)
+    EscalationStage _stages[AlarmConfig::MAX_STAGES];
+    uint8_t _ringStage;
+    uint8_t _volume;
+    uint8_t _rampTarget;
+    uint8_t _rampStepVol; // Volume added per ramp timer tick
+    bool _waking;         // Wake ramp running, stage ramp follows
 
     // Timers
-    unsigned long _alarmMillis;
+    TimerHandle_t _stageTimer;
+    TimerHandle_t _rampTimer;
+
+    Preferences _prefs;
 
     // Callbacks
     Callback _onAlarmEvent;
+    RampCallback _onWakeRamp;
+
+    mutable SemaphoreHandle_t _mtx; // Mutex safety
+    TaskHandle_t _task;
+
+    // Alarm task and DS3231 INT pin handler
+    static void _taskEntry(void *arg);
+    static void IRAM_ATTR _onRTCInterrupt(void *arg);
+    static void _onTimer(TimerHandle_t timer);
 
     // Private helpers
+    bool _checkFired(uint32_t &wakeMs);
+    void _enterStage(uint8_t idx, uint32_t wakeMs = 0);
+    void _startRamp(uint8_t target, uint32_t durationMs);
+    void _startStageRamp();
+    void _playStageTrack();
+    void _playTrack(const EscalationStage &stage);
+    void _rampStep();
+    void _stopRinging();
+    void _rebuildSchedule();
+    void _programRTC();
+    bool _handleFired(uint8_t slot, uint8_t &stage);
+    int _nextEntry(uint16_t minuteOfWeek) const;
+    void _commit();
+    void _save();
+    bool _load(bool &migrated);
+    bool _loadV1();
     bool _isRTCAlarmEnabled();
-    bool _fiveMinutesPassed();
-};
\ No newline at end of file
+};
@@ -0,0 +1,106 @@
+#pragma once
+#include "Widgets.h"
+#include <Arduino.h>
+#include <TFT_eSPI.h>
+
+// Animation.h
+// Timeline animations for the clock screen, advanced once per frame by the render task instead
+// of blocking on delay(). Flash and fade draw a colour over an area on top of the widgets. Slide
+// and blink move or hide a widget through its offset/visibility. Either way, every change is
+// reported as damage, so ending or cancelling an effect repaints only the area it touched.
+
+namespace AnimationConfig
+{
+constexpr uint8_t MAX_ANIMATIONS = 4; // Running at once
+constexpr uint8_t MAX_DAMAGE = 8;     // Overlay areas per frame, extra ones are merged
+} // namespace AnimationConfig
+
+enum class Ease : uint8_t
+{
+    Linear,
+    In,   // Quadratic, slow start
+    Out,  // Quadratic, slow end
+    InOut // Smoothstep
+};
+
+// Maps linear progress 0..1 through the curve
+float ease(Ease curve, float t);
+
+enum class Effect : uint8_t
+{
+    Flash, // Solid colour over an area
+    Fade,  // Colour over an area, blended from one colour to another
+    Slide, // Widget content moves from an offset back to its place
+    Blink  // Widget hidden every other period
+};
+
+struct Animation
+{
+    Effect effect;
+    Ease curve;
+    uint16_t id; // Starting an animation replaces the running one with the same id, 0 = none
+    uint32_t duration; // ms, 0 = until cancelled
+
+    Widget *widget; // Slide, Blink
+    Region area;    // Flash, Fade
+
+    uint16_t color;   // Flash colour, Fade start
+    uint16_t toColor; // Fade end
+    int16_t dx, dy;   // Slide start offset
+    uint16_t period;  // Blink half period, ms
+
+    static Animation flash(uint16_t id, const Region &area, uint16_t color, uint32_t ms);
+    static Animation fade(uint16_t id, const Region &area, uint16_t from, uint16_t to, uint32_t ms, Ease curve);
+    static Animation slide(uint16_t id, Widget *widget, int16_t dx, int16_t dy, uint32_t ms, Ease curve);
+    static Animation blink(uint16_t id, Widget *widget, uint16_t period, uint32_t ms = 0);
+};
+
+// Render task only
+class Animator
+{
+  public:
+    Animator();
+
+    // False if all slots are taken
+    bool start(const Animation &anim, uint32_t now);
+
+    // Ends animations early, restoring what they changed
+    void cancel(uint16_t id);
+    void cancelAll();
+
+    bool isRunning(uint16_t id) const;
+    bool active() const; // Anything running, the render task keeps a frame rate while true
+
+    // Moves every animation to time now, finishing the expired ones
+    void step(uint32_t now);
+
+    // Overlay areas changed since the last frame, reset by clean()
+    uint8_t damage(Region *out, uint8_t max) const;
+    void clean();
+    void invalidate(); // Panel was cleared, redraw every overlay
+
+    // Opaque overlay over the whole area: colour set, nothing beneath needs drawing
+    bool covers(const Region &area, uint16_t &color) const;
+
+    // Draws the overlays inside area, (dx, dy) maps screen to gfx coordinates
+    void draw(TFT_eSPI &gfx, int16_t dx, int16_t dy, const Region &area) const;
+
+  private:
+    struct Slot
+    {
+        bool used;
+        Animation anim;
+        uint32_t start;
+        uint16_t shown; // Overlay colour on the panel
+    };
+
+    Slot _slots[AnimationConfig::MAX_ANIMATIONS];
+    Region _damage[AnimationConfig::MAX_DAMAGE];
+    uint8_t _damageCount;
+
+    // Private helpers
+    void _finish(Slot &slot);
+    void _addDamage(const Region &area);
+    static bool _isOverlay(const Animation &anim);
+    static uint16_t _blend(uint16_t from, uint16_t to, float t);
+};
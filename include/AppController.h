@@ -1,10 +1,16 @@
 #pragma once
 #include "Buttons.h"             // Buttons hardware driver
+#include "Gestures.h"            // Click/long press/chord recognition
 #include "RFIDHandler.h"         // RFID input abstracion layer
-#include <DFRobotDFPlayerMini.h> // Audio control
+#include "AudioPlayer.h"         // Audio control
+#include "TrackCatalog.h"        // SD card track categories
 
 #include "AlarmSystem.h"
+#include "BrightnessController.h"
+#include "CardRegistry.h"
+#include "DisplayPower.h"
 #include "UI.h"
+#include <functional>
 
 // AppController.h
 // Maps physical input (Buttons, RFID) to output
@@ -12,7 +18,8 @@
 class AppController
 {
   public:
-    AppController(Buttons &btn, RFIDHandler &rfid, AlarmSystem &alm, UI &ui, DFRobotDFPlayerMini &player);
+    AppController(Buttons &btn, Gestures &gestures, RFIDHandler &rfid, AlarmSystem &alm, UI &ui, DisplayPower &power,
+                  BrightnessController &bright, AudioPlayer &player, TrackCatalog &tracks, CardRegistry &cards);
 
     // General input handler, internally calls individual input handlers
     void handleIn();
@@ -21,17 +28,71 @@ class AppController
     void handleButtonIn();
     void handleRFIDIn();
 
+    // Scanned card: enrolls it if enrollment is pending, else runs the card's action
+    void handleCardIn(const uint8_t *uid, uint8_t len);
+
+    using CardCommandCallback = std::function<void(const char *macro)>;
+    // Registers a callback that runs the command line of a Command card
+    void onCardCommand(CardCommandCallback cb);
+
   private:
     // In
     Buttons &_btn;
+    Gestures &_gestures;
     RFIDHandler &_rfid;
 
     // Out
     AlarmSystem &_alm;
     UI &_ui;
+    DisplayPower &_power;
+    BrightnessController &_bright;
+
+    AudioPlayer &_player;
+    TrackCatalog &_tracks;
+    CardRegistry &_cards;
+
+    CardCommandCallback _onCardCommand;
+
+    uint8_t _swallowMask; // Buttons whose press only woke the display, until released
+    State _bindingState;  // State the double click mask was set up for
+
+    // ========== GESTURE ACTIONS ==========
+    // Clock
+    void alarmEarlier(const Gesture &g);
+    void alarmLater(const Gesture &g);
+    void alarmEarlierFine(const Gesture &g);
+    void alarmLaterFine(const Gesture &g);
+    void playTrack(const Gesture &g);
+    void stopTrack(const Gesture &g);
+    void toggleAlarm(const Gesture &g);
+    void brightnessDown(const Gesture &g);
+    void brightnessUp(const Gesture &g);
+
+    using GestureAction = void (AppController::*)(const Gesture &g);
+    struct GestureBinding
+    {
+        GestureType type;
+        uint8_t buttons; // Button mask, see GestureConfig
+        GestureAction action;
+    };
 
-    DFRobotDFPlayerMini &_player;
+    // Binding tables, one per UI state
+    static constexpr size_t NUM_CLOCK_BINDINGS = 11; // Update when a binding is added!
+    const GestureBinding _clockBindings[NUM_CLOCK_BINDINGS] = {
+        {GestureType::Click, GestureConfig::BTN1, &AppController::alarmEarlier},
+        {GestureType::LongPress, GestureConfig::BTN1, &AppController::alarmEarlierFine},
+        {GestureType::Repeat, GestureConfig::BTN1, &AppController::alarmEarlierFine},
+        {GestureType::Click, GestureConfig::BTN2, &AppController::alarmLater},
+        {GestureType::LongPress, GestureConfig::BTN2, &AppController::alarmLaterFine},
+        {GestureType::Repeat, GestureConfig::BTN2, &AppController::alarmLaterFine},
+        {GestureType::Click, GestureConfig::BTN3, &AppController::playTrack},
+        {GestureType::DoubleClick, GestureConfig::BTN3, &AppController::stopTrack},
+        {GestureType::Click, GestureConfig::BTN4, &AppController::toggleAlarm},
+        {GestureType::Chord, GestureConfig::BTN1 | GestureConfig::BTN3, &AppController::brightnessDown},
+        {GestureType::Chord, GestureConfig::BTN2 | GestureConfig::BTN4, &AppController::brightnessUp}};
 
-    // Timers
-    unsigned long _lastPressedMillis;
-};
\ No newline at end of file
+    // Helpers
+    const GestureBinding *bindingsFor(State state, size_t &count) const;
+    void dispatchGesture(const Gesture &g);
+    void shiftAlarm(int minutes);
+};
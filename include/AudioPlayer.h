@@ -0,0 +1,112 @@
+#pragma once
+#include "Config.h"
+#include <Arduino.h>
+#include <DFRobotDFPlayerMini.h>
+#include <functional>
+
+// AudioPlayer.h
+// Asynchronous DFPlayer Mini front end. The audio task owns the UART,
+// callers only enqueue commands and return immediately.
+
+namespace AudioConfig
+{
+constexpr uint8_t QUEUE_LENGTH = 16;        // Pending command capacity
+constexpr uint32_t EVENT_POLL_MS = 20;      // UART check interval for player messages while idle
+constexpr uint32_t FINISH_DEDUPE_MS = 500;  // DFPlayer reports each finished track twice
+constexpr uint32_t UART_TIMEOUT_MS = 500;   // Ack wait before a command counts as timed out
+constexpr uint32_t QUERY_TIMEOUT_MS = 2000; // Caller wait for a query answered by the audio task
+} // namespace AudioConfig
+
+class AudioPlayer
+{
+  public:
+    AudioPlayer(DFRobotDFPlayerMini &player);
+
+    // Inits DFPlayer on given serial and starts audio task, returns whether the player responded
+    bool begin(Stream &serial);
+
+    // Non-blocking commands. Return false if the queue was full.
+    bool volume(uint8_t vol);
+    bool play(uint16_t track);
+    bool playFolder(uint8_t folder, uint8_t track);
+    bool stop();
+
+    enum class Query : uint8_t
+    {
+        FileCount,      // Files on the whole card
+        FolderCount,    // Numbered folders on the card
+        FolderFileCount // Files in one folder
+    };
+    // Blocking request answered by the audio task. Returns -1 on error or timeout.
+    // Must not be called from the audio task (e.g. a track finished callback).
+    int query(Query q, uint8_t folder = 0, uint32_t timeoutMs = AudioConfig::QUERY_TIMEOUT_MS);
+    // Non-blocking query, answered through onQueryAnswer. False if the queue was full.
+    bool queryAsync(Query q, uint8_t folder = 0);
+
+    struct Stats
+    {
+        uint32_t sent;      // Commands written to the UART
+        uint32_t coalesced; // Volume commands merged into a later one
+        uint32_t dropped;   // Commands rejected because the queue was full
+        uint32_t errors;    // Error/timeout reports from the player
+        uint8_t lastError;  // Last DFPlayer error code (see DFRobotDFPlayerMini.h)
+        uint32_t finished;  // Track finished events
+    };
+    Stats getStats() const;
+    bool isOnline() const;
+
+    //========== Callbacks ==========
+    using TrackCallback = std::function<void(uint16_t track)>;
+    // Registers a callback when the player finishes a track, called from the audio task
+    void onTrackFinished(TrackCallback cb) { _onTrackFinished = cb; }
+
+    using QueryCallback = std::function<void(Query q, uint8_t folder, int result)>;
+    // Registers a callback for queryAsync answers (-1 on error or timeout), called from the audio task
+    void onQueryAnswer(QueryCallback cb) { _onQueryAnswer = cb; }
+
+  private:
+    enum class Op : uint8_t
+    {
+        Volume,
+        Play,
+        PlayFolder,
+        Stop,
+        Query,
+        QueryAsync
+    };
+
+    struct Command
+    {
+        Op op;
+        uint8_t arg;    // volume or folder
+        uint16_t track; // track number or Query kind
+    };
+
+    DFRobotDFPlayerMini &_player;
+    bool _online;
+
+    QueueHandle_t _queue;
+    TaskHandle_t _task;
+
+    // One query in flight at a time, answered through _queryResult
+    SemaphoreHandle_t _queryMtx;
+    SemaphoreHandle_t _queryDone;
+    volatile int _queryResult;
+
+    // Audio task state
+    int16_t _volume; // Last volume sent, -1 if unknown
+    uint16_t _lastFinished;
+    unsigned long _lastFinishedMillis;
+    Stats _stats;
+
+    // Callbacks
+    TrackCallback _onTrackFinished;
+    QueryCallback _onQueryAnswer;
+
+    // Private helpers
+    static void _taskEntry(void *arg);
+    bool _enqueue(const Command &cmd);
+    void _execute(const Command &cmd);
+    int _read(Query q, uint8_t folder);
+    void _handleMessages();
+};
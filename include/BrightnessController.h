@@ -1,9 +1,16 @@
 #pragma once
 #include "Config.h"
 #include <Arduino.h>
+#include <driver/adc.h>
+#include <driver/ledc.h>
+#include <esp_adc_cal.h>
+#include <Preferences.h>
+#include <functional>
 
 // BrightnessController.h
-// Hardware controller that updates tft backlight pin voltage using ambient light level
+// Hardware controller that updates tft backlight pin voltage using ambient light level.
+// A sampler task filters the light sensor and starts fades on the LEDC fade engine,
+// levels are perceptual (gamma corrected to PWM duty).
 
 namespace BrightnessConfig
 {
@@ -11,22 +18,57 @@ namespace BrightnessConfig
 constexpr uint8_t BRIGHTNESS_MIN = 1;   // Minimum disp brightness
 constexpr uint8_t BRIGHTNESS_MAX = 255; // Maximum disp brightness
 
-// Photoresistor ambient light control
-constexpr uint16_t LIGHT_SENSOR_MIN = 120;       // ADC reading for darkest environment
-constexpr uint16_t LIGHT_SENSOR_MAX = 1200;      // ADC reading for bright environment
-constexpr uint8_t LIGHT_HYSTERESIS = 50;         // Prevent brightness flickering
-constexpr uint32_t LIGHT_UPDATE_INTERVAL = 5000; // Check light level every 5 seconds
+// Photoresistor ambient light control (calibrated millivolts at the sensor pin)
+constexpr uint16_t LIGHT_MV_MIN = 240;  // Darkest environment (factory curve)
+constexpr uint16_t LIGHT_MV_MAX = 1100; // Bright environment (factory curve)
+
+// Learned ambient -> brightness curve. Knots are refitted by manual nudges and expanded
+// into a 256 entry lookup table, so each ambient update is a single table read.
+constexpr uint16_t CURVE_MV_SPAN = 2048;                       // Sensor range covered (8 mV per table entry)
+constexpr uint8_t CURVE_KNOTS = 9;                             // Knot every 32 table entries (256 mV)
+constexpr uint16_t KNOT_SPACING = 256 / (CURVE_KNOTS - 1);     // Table entries between knots
+constexpr uint8_t MAX_CORRECTIONS = 16;                        // Most recent nudges kept
+constexpr uint8_t NUDGE_STEP = 16;                             // Default nudge size
+
+// Factory curve: linear between LIGHT_MV_MIN and LIGHT_MV_MAX
+constexpr uint8_t seedLevel(uint32_t mv)
+{
+    return mv <= LIGHT_MV_MIN   ? BRIGHTNESS_MIN
+           : mv >= LIGHT_MV_MAX ? BRIGHTNESS_MAX
+                                : BRIGHTNESS_MIN + (mv - LIGHT_MV_MIN) * (BRIGHTNESS_MAX - BRIGHTNESS_MIN) / (LIGHT_MV_MAX - LIGHT_MV_MIN);
+}
+constexpr uint32_t KNOT_MV = (uint32_t)CURVE_MV_SPAN * KNOT_SPACING / 256;
+constexpr uint8_t DEFAULT_KNOTS[CURVE_KNOTS] = {
+    seedLevel(0 * KNOT_MV), seedLevel(1 * KNOT_MV), seedLevel(2 * KNOT_MV),
+    seedLevel(3 * KNOT_MV), seedLevel(4 * KNOT_MV), seedLevel(5 * KNOT_MV),
+    seedLevel(6 * KNOT_MV), seedLevel(7 * KNOT_MV), seedLevel(8 * KNOT_MV)};
+
+// Ambient sampler
+constexpr uint32_t SAMPLE_PERIOD_MS = 100;     // One filtered reading per period
+constexpr uint8_t SAMPLE_BURST = 5;            // Raw reads per period, median taken (odd)
+constexpr uint32_t TARGET_INTERVAL_MS = 1000;  // How often the brightness target is re-evaluated
+constexpr uint32_t RETARGET_MIN_MS = 5000;     // Least time between two ambient fades
+constexpr uint16_t DEFAULT_RISE_TAU_MS = 2000; // Smoothing time constant when the room gets brighter
+constexpr uint16_t DEFAULT_FALL_TAU_MS = 8000; // ... and darker (slower, so a passing shadow doesn't dim)
+
+// Lux estimate: photoresistor from 3.3V to the pin, 4.7kΩ pulldown
+constexpr float SUPPLY_MV = 3300.0f;
+constexpr float DIVIDER_OHMS = 4700.0f;
+constexpr float LDR_R10_OHMS = 10000.0f; // Photoresistor resistance at 10 lux (GL55xx class)
+constexpr float LDR_GAMMA = 0.7f;        // log10(R) slope per decade of lux
 
 // Brightness fade settings
-constexpr uint8_t FADE_STEP_SIZE = 2;               // How much to change brightness per step (smaller = smoother)
-constexpr uint32_t FADE_STEP_DELAY = 5;             // Milliseconds between fade steps (smaller = faster fade)
-constexpr uint8_t BRIGHTNESS_CHANGE_THRESHOLD = 20; // Minimum change in brightness needed to trigger fade
-                                                    // Current calibration for 4.7kΩ pulldown resistor - tuned for room lighting ~1100 = 90%+ brightness
+constexpr uint32_t FADE_TIME_MS = 640;              // Fade time across the full range (shorter fades scale down)
+constexpr uint8_t FADE_SEGMENTS = 8;                // Linear hardware fades chained to follow the gamma curve
+constexpr uint32_t MIN_SEGMENT_MS = 20;             // Short fades use fewer segments
+constexpr float GAMMA = 2.2f;                       // Perceived brightness -> duty exponent
+constexpr uint8_t BRIGHTNESS_CHANGE_THRESHOLD = 8; // Minimum change in brightness needed to trigger fade
+                                                   // Current calibration for 4.7kΩ pulldown resistor - tuned for room lighting ~1100 mV = 90%+ brightness
 
 // PWM channel and frequency settings
 static const uint8_t PWM_CHANNEL = 0;       // PWM channel (0-15 available)
 static const uint32_t PWM_FREQUENCY = 5000; // 5kHz PWM frequency
-static const uint8_t PWM_RESOLUTION = 8;    // 8-bit resolution (0-255)
+static const uint8_t PWM_RESOLUTION = 12;   // 12-bit resolution (0-4095) so low levels stay smooth
 
 } // namespace BrightnessConfig
 
@@ -43,17 +85,61 @@ class BrightnessController
 
     void setBrightness(uint8_t level);
     void setTargetBrightness(uint8_t level);
+    void rampTo(uint8_t level, uint32_t durationMs);
 
-    void updateFade();
-    void updateAmbient();
+    // Caps the ambient level (display power states), 0 turns the backlight off.
+    // Raising the cap jumps straight to the new level, lowering it fades.
+    void setLimit(uint8_t limit);
+    uint8_t getLimit() const;
 
     uint8_t getBrightness() const;
     uint8_t getTargetBrightness() const;
     bool isFading() const;
 
+    // Filtered ambient light
+    float getLightMv() const;
+    float getLux() const;
+
+    // Learned curve: nudges brightness for the current light level and teaches the curve.
+    // Returns false if there is no light reading yet.
+    bool nudge(int delta);
+    void resetCurve();
+    uint8_t getKnot(uint8_t idx) const;
+
+    struct Correction
+    {
+        uint8_t bin;   // Table entry (light level) the nudge was made at
+        uint8_t level; // Brightness chosen there
+    };
+    uint8_t getCorrections(Correction *out, uint8_t max) const; // Newest first
+
+    //========== Callbacks ==========
+    using FadeCallback = std::function<void(uint8_t level)>;
+    // Registers a callback when a fade reaches its target, called from the timer service task
+    void onFadeComplete(FadeCallback cb) { _onFadeComplete = cb; }
+
   private:
-    uint16_t readLightSensor() const;
-    uint8_t calculateAmbientBrightness();
+    uint8_t calculateAmbientBrightness(float mv) const;
+
+    // Learned curve (caller holds _mtx)
+    static uint8_t _bin(float mv);
+    void _refit(uint8_t bin, uint8_t level);
+    void _rebuildLut();
+    void _saveCurve();
+    void _loadCurve();
+
+    // Ambient sampler task
+    static void _samplerEntry(void *arg);
+    uint32_t _readMedianMv();
+    void _filter(uint32_t mv, uint32_t dtMs);
+
+    // Fade engine (runs on the timer service task)
+    void _requestFade(uint8_t level, uint32_t durationMs);
+    static void _applyRequest(void *arg, uint32_t unused);
+    static void _segmentDone(void *arg, uint32_t duty);
+    static bool IRAM_ATTR _onFadeEnd(const ledc_cb_param_t *param, void *arg);
+    void _startSegment();
+    uint8_t _levelOf(uint32_t duty) const;
 
   private:
     uint8_t _pwmPin;
@@ -62,10 +148,40 @@ class BrightnessController
     uint8_t _pwmRes;
     uint8_t _photoresistorPin;
 
-    uint8_t _currentBrightness;
+    ledc_mode_t _ledcMode;
+    ledc_channel_t _ledcChannel;
+    uint16_t _gamma[256]; // Perceptual level -> PWM duty
+
+    volatile uint8_t _currentBrightness; // Level reached by the last finished segment
     uint8_t _targetBrightness;
+    volatile bool _fading;
+    volatile bool _ramping;   // Timed ramp in progress, ambient updates wait for it
+    volatile uint8_t _limit;  // Ambient level cap
+    volatile uint32_t _request; // Pending fade: level << 24 | duration ms
+
+    // Active fade
+    uint8_t _fadeFrom;
+    uint8_t _fadeTo;
+    uint8_t _segment;
+    uint8_t _segmentCount;
+    uint32_t _segmentMs;
+    uint32_t _segmentDuty; // Duty the running segment ends at
+
+    // Ambient sampler state
+    adc1_channel_t _adcChannel;
+    esp_adc_cal_characteristics_t _adcChars;
+    volatile float _lightMv; // Smoothed sensor voltage, <0 until the first sample
+    volatile float _lux;
+
+    // Learned curve
+    uint8_t _knots[BrightnessConfig::CURVE_KNOTS];
+    uint8_t _lut[256];
+    Correction _corrections[BrightnessConfig::MAX_CORRECTIONS]; // Ring buffer
+    uint8_t _correctionHead;
+    uint8_t _correctionCount;
+    Preferences _prefs;
+    SemaphoreHandle_t _mtx; // Curve is taught from loop and read by the sampler
 
-    uint16_t _lastLightReading;
-    unsigned long _lastFadeUpdate;
-    unsigned long _lastAmbientUpdate;
-};
\ No newline at end of file
+    // Callbacks
+    FadeCallback _onFadeComplete;
+};
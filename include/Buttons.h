@@ -1,29 +1,56 @@
 #pragma once
 #include "Log.h"
 #include <Arduino.h>
+#include <atomic>
 #include <stdint.h>
 
 // Buttons.h
-// Handles reading the state of physical buttons
+// Handles reading the state of physical buttons. Pin change interrupts queue timestamped
+// edges, update() debounces them into button events and a per-loop state snapshot.
 
-struct Button
+namespace ButtonConfig
 {
-    bool isDown = false;   // current level
-    bool pressed = false;  // rising edge
-    bool released = false; // falling edge
-};
+constexpr uint8_t COUNT = 4;
+constexpr uint32_t DEBOUNCE_MS = 25;    // Edges this soon after an accepted edge are bounce
+constexpr uint8_t EDGE_QUEUE_LEN = 64;  // Raw edges held between update() calls
+constexpr uint8_t EVENT_QUEUE_LEN = 16; // Debounced events waiting to be read
+} // namespace ButtonConfig
 
+// Snapshot of all buttons packed in one word: a byte each for down, pressed and released,
+// one bit per button (bit 0 = btn1)
 struct ButtonState
 {
-    Button btn1;
-    Button btn2;
-    Button btn3;
-    Button btn4;
-    bool anyDown() const { return btn1.isDown || btn2.isDown || btn3.isDown || btn4.isDown; }
-    bool anyPressed() const { return btn1.pressed || btn2.pressed || btn3.pressed || btn4.pressed; }
-    bool anyReleased() const { return btn1.released || btn2.released || btn3.released || btn4.released; }
-
-    bool singlePressed() const { return btn1.pressed + btn2.pressed + btn3.pressed + btn4.pressed == 1; }
+    static constexpr uint8_t DOWN_SHIFT = 0;     // current level
+    static constexpr uint8_t PRESSED_SHIFT = 8;  // rising edge
+    static constexpr uint8_t RELEASED_SHIFT = 16; // falling edge
+    static constexpr uint32_t BUTTON_MASK = (1UL << ButtonConfig::COUNT) - 1;
+
+    uint32_t bits;
+
+    explicit ButtonState(uint32_t b = 0) : bits(b) {}
+
+    uint8_t downMask() const { return (bits >> DOWN_SHIFT) & BUTTON_MASK; }
+    uint8_t pressedMask() const { return (bits >> PRESSED_SHIFT) & BUTTON_MASK; }
+    uint8_t releasedMask() const { return (bits >> RELEASED_SHIFT) & BUTTON_MASK; }
+
+    bool isDown(uint8_t button) const { return downMask() & (1 << button); }
+    bool pressed(uint8_t button) const { return pressedMask() & (1 << button); }
+    bool released(uint8_t button) const { return releasedMask() & (1 << button); }
+
+    bool anyDown() const { return downMask() != 0; }
+    bool anyPressed() const { return pressedMask() != 0; }
+    bool anyReleased() const { return releasedMask() != 0; }
+
+    // Exactly one bit set
+    bool singlePressed() const { return pressedMask() && !(pressedMask() & (pressedMask() - 1)); }
+};
+
+// One debounced press or release
+struct ButtonEvent
+{
+    uint32_t ms;    // millis() of the edge
+    uint8_t button; // 0-3 for btn1-btn4
+    bool down;      // true = pressed, false = released
 };
 
 class Buttons
@@ -33,12 +60,52 @@ class Buttons
 
     void begin();
 
+    // Debounces queued edges (no pin reads). Called every loop.
     void update();
+
+    // Snapshot from the last update(), one atomic load (safe from any task or ISR)
     ButtonState getState() const;
 
+    // Next debounced event in order, false if none. Single consumer (loop task).
+    bool nextEvent(ButtonEvent &ev);
+    void clearEvents();
+
   private:
-    uint8_t _btn1, _btn2, _btn3, _btn4;
-    ButtonState _currState;
-    ButtonState _prevState;
-    mutable SemaphoreHandle_t _mtx; // Mutex safety
+    uint8_t _pins[ButtonConfig::COUNT];
+    std::atomic<uint32_t> _currState; // ButtonState bits, published with one store
+
+    // Edge queue, single producer (pin ISR) single consumer (update)
+    struct Edge
+    {
+        uint32_t ms;
+        uint8_t button;
+        bool down;
+    };
+    struct IsrArg
+    {
+        Buttons *self;
+        uint8_t button;
+    };
+    IsrArg _isrArgs[ButtonConfig::COUNT];
+    Edge _edges[ButtonConfig::EDGE_QUEUE_LEN];
+    std::atomic<uint8_t> _edgeHead; // Written by the ISR
+    std::atomic<uint8_t> _edgeTail; // Written by update()
+    std::atomic<bool> _overflow;
+    volatile bool _isrDown[ButtonConfig::COUNT]; // Level at the latest edge
+
+    // Debounce state (update() only)
+    bool _stable[ButtonConfig::COUNT];       // Accepted level
+    bool _raw[ButtonConfig::COUNT];          // Level at the latest queued edge
+    uint32_t _rawMs[ButtonConfig::COUNT];    // ... and its time
+    uint32_t _lockUntil[ButtonConfig::COUNT]; // End of the bounce lockout
+
+    // Debounced events (loop task only)
+    ButtonEvent _events[ButtonConfig::EVENT_QUEUE_LEN];
+    uint8_t _eventHead;
+    uint8_t _eventTail;
+
+    // Private helpers
+    static void IRAM_ATTR _onEdge(void *arg);
+    void _debounce(uint8_t button, bool down, uint32_t ms, uint32_t &state);
+    void _commit(uint8_t button, bool down, uint32_t ms, uint32_t &state);
 };
\ No newline at end of file
@@ -0,0 +1,77 @@
+#pragma once
+#include <Arduino.h>
+#include <Preferences.h>
+
+// CardRegistry.h
+// Authorized RFID cards and what each one does. Cards are kept as raw UID bytes behind a
+// small hash index, lookups compare in constant time and never format strings.
+
+namespace CardConfig
+{
+constexpr uint8_t MAX_CARDS = 8;
+constexpr uint8_t SLOTS = 16;       // Hash index size (power of two, > MAX_CARDS)
+constexpr uint8_t MAX_UID_LEN = 10; // Triple size UID
+constexpr uint8_t MACRO_LEN = 48;   // Command line run by a Command card, including terminator
+constexpr uint8_t UID_STR_LEN = MAX_UID_LEN * 2 + 1;
+constexpr uint8_t EMPTY_SLOT = 0xFF;
+} // namespace CardConfig
+
+enum class CardAction : uint8_t
+{
+    Dismiss,     // Dismisses a ringing alarm
+    ToggleAlarm, // Enables/disables the alarm
+    Command      // Runs a CommandInterface command line
+};
+
+struct Card
+{
+    uint8_t len;
+    uint8_t uid[CardConfig::MAX_UID_LEN]; // Zero padded
+    CardAction action;
+    char macro[CardConfig::MACRO_LEN]; // Command cards only
+};
+
+class CardRegistry
+{
+  public:
+    CardRegistry();
+
+    // Loads cards from flash. The first boot enrolls ALARM_CARD_UID (Config.h) as a dismiss card.
+    void begin();
+
+    // Copies the card with this UID, false if not enrolled
+    bool match(const uint8_t *uid, uint8_t len, Card &out) const;
+
+    uint8_t count() const;
+    bool get(uint8_t idx, Card &out) const;
+    bool add(const uint8_t *uid, uint8_t len, CardAction action, const char *macro = "");
+    bool remove(uint8_t idx);
+
+    // Enrollment: the next scanned card is added with this action
+    void startEnroll(CardAction action, const char *macro = "");
+    void cancelEnroll();
+    bool isEnrolling() const;
+    bool completeEnroll(const uint8_t *uid, uint8_t len); // false if the table is full
+
+    static const char *actionName(CardAction action);
+    static void formatUID(const uint8_t *uid, uint8_t len, char out[CardConfig::UID_STR_LEN]);
+    static uint8_t parseUID(const char *hex, uint8_t out[CardConfig::MAX_UID_LEN]); // Returns length, 0 if invalid
+
+  private:
+    Card _cards[CardConfig::MAX_CARDS];
+    uint8_t _count;
+    uint8_t _slots[CardConfig::SLOTS]; // Card index per hash slot
+
+    bool _enrolling;
+    Card _pending; // Action and macro for the card being enrolled
+
+    Preferences _prefs;
+    SemaphoreHandle_t _mtx; // Loop task scans, command interface edits (Blynk task)
+
+    // Private helpers
+    static uint32_t _hash(const uint8_t *uid, uint8_t len);
+    static bool _equal(const Card &card, const uint8_t *uid, uint8_t len);
+    int _find(const uint8_t *uid, uint8_t len) const;
+    void _reindex();
+    void _save();
+};
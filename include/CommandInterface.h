@@ -1,9 +1,13 @@
 #pragma once
 #include "AlarmSystem.h"
+#include "BrightnessController.h"
+#include "CardRegistry.h"
 #include "NetworkManager.h"
+#include "SpiBus.h"
 #include "Timekeeper.h"
+#include "TrackCatalog.h"
 #include "UI.h"
-#include <DFRobotDFPlayerMini.h>
+#include "AudioPlayer.h"
 
 // command_interface.h
 //  Abstraction class between received system commands and logic
@@ -11,16 +15,21 @@
 class CommandInterface
 {
   public:
-    CommandInterface(DFRobotDFPlayerMini &player, Timekeeper &tk, UI &ui, NetworkManager &net, AlarmSystem &alm);
+    CommandInterface(AudioPlayer &player, TrackCatalog &tracks, Timekeeper &tk, UI &ui, NetworkManager &net, AlarmSystem &alm, BrightnessController &bright,
+                     CardRegistry &cards, SpiBus &spi);
 
-    // Source control
-    const char *handleBlynkIn(const char *line);
-    void handleSerialIn();
+    void begin(); // Creates the command mutex, call before the Blynk task starts
 
-    // For manual command input
-    void processCommandLine(char *line);
+    // Source control. One command runs at a time: Blynk comes from the Blynk task and waits,
+    // serial and cards come from the loop and are turned away while a Blynk command runs.
+    const char *handleBlynkIn(const char *line); // Reply stays valid until the next Blynk line
+    void handleSerialIn();
+    void handleCardIn(const char *macro); // Command card line, the reply goes to serial
 
   private:
+    // Command lock held
+    void processCommandLine(char *line);
+    void runLocal(char *line); // Serial and card lines, on the loop task
     void dispatchCommand(int argc, char *argv[]);
 
     // ========== COMMAND HANDLERS ==========
@@ -29,15 +38,26 @@ class CommandInterface
     void cmdStatus(int argc, char *argv[]);
     void cmdTime(int argc, char *argv[]);
     void cmdLog(int argc, char *argv[]);
+    void cmdConfig(int argc, char *argv[]);
 
     // Alarm
     void cmdAlarm(int argc, char *argv[]);
     void cmdAlarmType(int argc, char *argv[]);
+    void cmdEscalation(int argc, char *argv[]);
 
     // Player
     void cmdVol(int argc, char *argv[]);
     void cmdPlay(int argc, char *argv[]);
     void cmdStop(int argc, char *argv[]);
+    void cmdTracks(int argc, char *argv[]);
+    void cmdPlaylist(int argc, char *argv[]);
+
+    // Display
+    void cmdBrightness(int argc, char *argv[]);
+    void cmdBench(int argc, char *argv[]);
+
+    // RFID
+    void cmdCard(int argc, char *argv[]);
 
     // Network
     void cmdWiFiSession(int argc, char *argv[]);
@@ -47,15 +67,20 @@ class CommandInterface
     static constexpr size_t MAX_ARGS = 8;
     static constexpr size_t CMD_IN_SIZE = 128; // max size of input buffer
     static constexpr size_t CMD_OUT_SIZE = 512;
+    static constexpr uint32_t LOCK_WAIT_MS = 50; // Loop task wait for a running Blynk command
 
-    static constexpr size_t NUM_COMMANDS = 11; // Update when new command is added!
+    static constexpr size_t NUM_COMMANDS = 18; // Update when new command is added!
 
     // Objects
-    DFRobotDFPlayerMini &_player;
+    AudioPlayer &_player;
+    TrackCatalog &_tracks;
     Timekeeper &_tk;
     UI &_ui;
     NetworkManager &_net;
     AlarmSystem &_alm;
+    BrightnessController &_bright;
+    CardRegistry &_cards;
+    SpiBus &_spi;
 
     using CommandHandler = void (CommandInterface::*)(int argc, char *argv[]);
     struct Command
@@ -70,17 +95,30 @@ class CommandInterface
         {"status", &CommandInterface::cmdStatus, "status"},
         {"time", &CommandInterface::cmdTime, "time <set> <hour> <minute> <month> <day> <year>"},
         {"log", &CommandInterface::cmdLog, "log <log <message>> || <pop> || <size> || <printall> || <dumpbuffer> || <save> || <load>"},
-        {"alarm", &CommandInterface::cmdAlarm, "alarm <set> <hour><minute> || <toggle>"},
-        {"alarmtype", &CommandInterface::cmdAlarmType, "alarmtype <loud || normal || buzzer || all || int(trackNumber)> <vol>"},
+        {"config", &CommandInterface::cmdConfig, "config <list> || <get name> || <set name value> || <reset name>"},
+        {"alarm", &CommandInterface::cmdAlarm, "alarm <set hr min> || <add hr min [once || daily || weekdays || weekends || 0-6]> || <list> || <remove n> || <skip n> || <enable n> || <disable [n]> || <stage n s> || <ramp [min] [sync || nosync]>"},
+        {"alarmtype", &CommandInterface::cmdAlarmType, "alarmtype <loud || normal || buzzer || all || int(trackNumber)> <vol> [shuffle || random]"},
+        {"escalation", &CommandInterface::cmdEscalation, "escalation <list> || <set stage <category c [track]> || <vol v> || <ramp steps/min> || <duration sec> || <next stage>>"},
         {"vol", &CommandInterface::cmdVol, "vol <0-30>"},
         {"play", &CommandInterface::cmdPlay, "play <folder> <track> [vol = DEFAULT]"},
         {"stop", &CommandInterface::cmdStop, "stop"},
+        {"tracks", &CommandInterface::cmdTracks, "tracks [rescan]"},
+        {"playlist", &CommandInterface::cmdPlaylist, "playlist <category> [reshuffle || weight <track> <0-9>]"},
+        {"brightness", &CommandInterface::cmdBrightness, "brightness [up [n] || down [n] || curve || reset]"},
+        {"bench", &CommandInterface::cmdBench, "bench [runs = 10]"},
+        {"card", &CommandInterface::cmdCard, "card <list> || <enroll dismiss || toggle || cmd <command...>> || <remove n> || <cancel>"},
         {"sync", &CommandInterface::cmdSync, "sync <time> || <weather>"},
         {"wifisession", &CommandInterface::cmdWiFiSession, "wifisession <on> || <off>"}};
 
+    SemaphoreHandle_t _mtx; // Guards _cmdOut and the strtok state
+
     // Command output buffer
     char _cmdOut[CMD_OUT_SIZE];
+    char _blynkOut[CMD_OUT_SIZE]; // Last Blynk reply, read by the Blynk task after the lock is released
 
     // Helpers
     bool parseLong(char *arg, long &out, const char *name);
+    bool parseAlarmTime(char *hrArg, char *minArg, uint8_t &hr, uint8_t &min);
+    bool parseDays(char *arg, uint8_t &out);
+    void formatDays(uint8_t days, char out[10]);
 };
\ No newline at end of file
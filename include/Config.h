@@ -1,7 +1,6 @@
 #pragma once
 #include "Vault.h"
 #include <stdint.h>
-#include <utility>
 
 // TODO: Make namespace-based for better grouping
 
@@ -19,6 +18,7 @@ namespace Pins
 constexpr uint8_t RFID_CS_PIN = 5;    // SDA/SS pin for RFID
 constexpr uint8_t RFID_RST_PIN = 25;  // Reset pin for RFID
 constexpr uint8_t RFID_MISO_PIN = 19; // MISO pin for RFID
+constexpr uint8_t RFID_IRQ_PIN = 35;  // IRQ pin for RFID (active low, driven push-pull by the RC522)
 
 // Control button pins
 constexpr uint8_t BUTTON_1_PIN = 14; // top left
@@ -26,6 +26,9 @@ constexpr uint8_t BUTTON_2_PIN = 27; // top right
 constexpr uint8_t BUTTON_3_PIN = 33; // bottom left
 constexpr uint8_t BUTTON_4_PIN = 32; // bottom right
 
+// DS3231 INT/SQW output (open drain, active low when an alarm fires)
+constexpr uint8_t RTC_INT_PIN = 13;
+
 // TFT LED brightness control
 constexpr uint8_t TFT_LED_PIN = 26;       // PWM pin for TFT backlight control
 constexpr uint8_t PHOTORESISTOR_PIN = 34; // ADC pin for ambient light sensor
@@ -43,37 +46,29 @@ constexpr uint16_t TEXT_COLOR = 0xFFFF;       // White
 
 /*
 ========== MicroSD Card Contents ==========
-Root:
--- Buzzer --
-0001: Three square tone 1000hz
-
--- Soft(er) wakeup songs --
-0002: Never Gonna Give You Up - Rick Astley
-0003: Fortunate Son - Creedence Clearwater Revival
-0004: Mii Channel Theme But Horrendous
-0005: Circle of Life - The Lion King
-0006: Thneedville - The Lorax
-0007: Coconut Mall but in 6/8 Time SIgnature
-0008: Smooth Criminal but Every Other Beat is Missing
-0009: The Coconut Song
-
--- Hard wakeup songs --
-0010: GOOOOOOD MORNING VIETNAM
-0011: BOTW Guardian Theme
-0012: SCOTLAND FOREVER
+Each numbered folder is a track category (see TrackCatalog.h). Track counts are
+read from the card at boot, so folders can be added to or changed freely.
+A card with files only in the root still works as a single category.
+
+01/ -- Buzzer --
+001: Three square tone 1000hz
+
+02/ -- Soft(er) wakeup songs --
+001: Never Gonna Give You Up - Rick Astley
+002: Fortunate Son - Creedence Clearwater Revival
+003: Mii Channel Theme But Horrendous
+004: Circle of Life - The Lion King
+005: Thneedville - The Lorax
+006: Coconut Mall but in 6/8 Time SIgnature
+007: Smooth Criminal but Every Other Beat is Missing
+008: The Coconut Song
+
+03/ -- Hard wakeup songs --
+001: GOOOOOOD MORNING VIETNAM
+002: BOTW Guardian Theme
+003: SCOTLAND FOREVER
 */
 
-namespace Tracks
-{
-// Track type ranges (ex: normal songs is spanning track 2 to track 9)
-constexpr std::pair<uint8_t, uint8_t> buzzers = {1, 1};
-constexpr std::pair<uint8_t, uint8_t> normalSongs{2, 9};
-constexpr std::pair<uint8_t, uint8_t> loudSongs{10, 12};
-constexpr std::pair<uint8_t, uint8_t> allSongs{1, 12};
-
-constexpr uint8_t totalTrackCount = 12;
-} // namespace Tracks
-
 //!!! Going higher than 25 risks speaker damage !!!
 constexpr uint8_t PLAYER_VOLUME = 20; // min 0, max 30
 
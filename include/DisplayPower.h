@@ -0,0 +1,100 @@
+#pragma once
+#include "BrightnessController.h"
+#include "SpiBus.h"
+#include "Timekeeper.h"
+#include <Arduino.h>
+#include <TFT_eSPI.h>
+#include <functional>
+
+// DisplayPower.h
+// Display power states. Steps the backlight and ST7789 down with inactivity, room darkness
+// and the night schedule, and brings everything back at once on input or an alarm.
+
+namespace DisplayPowerConfig
+{
+// Defaults for the user settings (see Settings.h)
+constexpr uint16_t DEFAULT_DIM_AFTER_S = 60;      // Inactivity before dimming in a dark room or at night
+constexpr uint16_t DEFAULT_NIGHT_START = 23 * 60; // 23:00
+constexpr uint16_t DEFAULT_NIGHT_END = 7 * 60;    // 07:00
+
+// Deeper states, by inactivity
+constexpr uint32_t IDLE_AFTER_MS = 5 * 60 * 1000UL;   // Idle mode in a dark room or at night
+constexpr uint32_t OFF_AFTER_MS = 10 * 60 * 1000UL;   // Backlight off in a dark room at night
+constexpr uint32_t SLEEP_AFTER_MS = 30 * 60 * 1000UL; // Panel sleep in a dark room at night
+
+// Backlight caps
+constexpr uint8_t DIM_LEVEL = 24;
+constexpr uint8_t IDLE_LEVEL = 8;
+
+// Dark room detection (hysteresis)
+constexpr float DARK_LUX = 2.0f;
+constexpr float LIGHT_LUX = 5.0f;
+
+constexpr uint32_t POLICY_INTERVAL_MS = 250; // How often run() re-evaluates the state
+
+// ST7789 commands
+constexpr uint8_t CMD_SLPIN = 0x10;
+constexpr uint8_t CMD_SLPOUT = 0x11;
+constexpr uint8_t CMD_IDMOFF = 0x38;
+constexpr uint8_t CMD_IDMON = 0x39;
+constexpr uint32_t SLPOUT_SETTLE_MS = 5;     // After SLPOUT before the next command
+constexpr uint32_t SLPOUT_TO_SLPIN_MS = 120; // After SLPOUT before SLPIN is allowed
+} // namespace DisplayPowerConfig
+
+// Ordered from fully on to deepest sleep
+enum class PowerState : uint8_t
+{
+    On,
+    Dim,          // Backlight capped
+    Idle,         // ST7789 idle mode (8 colours), backlight at a low cap
+    BacklightOff, // Idle mode, backlight off, nothing is drawn
+    Sleep         // ST7789 sleep (SLPIN), no SPI traffic
+};
+
+class DisplayPower
+{
+  public:
+    DisplayPower(TFT_eSPI &tft, SpiDevice &spi, BrightnessController &bright, Timekeeper &tk);
+
+    void begin();
+
+    // Re-evaluates the power state, called every loop
+    void run();
+
+    // User activity. Returns true if the display was dark, so the caller can swallow the press.
+    bool wake();
+
+    // Keeps the display fully on (alarm ringing)
+    void hold(bool on);
+
+    PowerState getState() const;
+    bool isDark() const; // Nothing visible, UI skips drawing
+    static const char *stateName(PowerState state);
+
+    //========== Callbacks ==========
+    using StateCallback = std::function<void(PowerState state)>;
+    // Registers a callback on every state change, called from the loop task
+    void onStateChange(StateCallback cb) { _onStateChange = cb; }
+
+  private:
+    TFT_eSPI &_tft;
+    SpiDevice &_spi;
+    BrightnessController &_bright;
+    Timekeeper &_tk;
+
+    PowerState _state;
+    bool _held;
+    bool _dark;     // Room is dark (hysteresis state)
+    bool _idleMode; // ST7789 idle mode on
+    bool _asleep;   // ST7789 in sleep
+    unsigned long _lastActivity;
+    unsigned long _lastPolicy;
+    unsigned long _awakeSince; // Last SLPOUT
+
+    StateCallback _onStateChange;
+
+    // Private helpers
+    PowerState _policy(unsigned long inactiveMs);
+    bool _inNight() const;
+    void _apply(PowerState target);
+};
@@ -0,0 +1,105 @@
+#pragma once
+#include "Buttons.h"
+#include <Arduino.h>
+
+// Gestures.h
+// Turns debounced button events into clicks, double clicks, long presses (with auto-repeat)
+// and chords. Timeouts run on FreeRTOS software timers, nothing is re-checked per loop.
+
+namespace GestureConfig
+{
+// Default timings (see Settings.h for the user adjustable ones)
+constexpr uint16_t DEFAULT_DOUBLE_CLICK_MS = 300; // Max gap between the clicks of a double click
+constexpr uint16_t DEFAULT_LONG_PRESS_MS = 600;   // Hold time for a long press
+constexpr uint16_t DEFAULT_REPEAT_MS = 150;       // Auto-repeat period while a long press is held
+constexpr uint16_t DEFAULT_CHORD_MS = 80;         // Max gap between the presses of a chord
+
+constexpr uint8_t QUEUE_LENGTH = 16;      // Gestures waiting for the loop
+constexpr uint32_t STALE_SLACK_MS = 5;    // Timer callbacks this early belong to an older arm
+
+// Button masks
+constexpr uint8_t BTN1 = 1 << 0;
+constexpr uint8_t BTN2 = 1 << 1;
+constexpr uint8_t BTN3 = 1 << 2;
+constexpr uint8_t BTN4 = 1 << 3;
+} // namespace GestureConfig
+
+enum class GestureType : uint8_t
+{
+    Click,       // Press and release (after the double click window if the button has a double click)
+    DoubleClick, // Second press within the window
+    LongPress,   // Held for the long press time
+    Repeat,      // Every repeat period after a long press while still held
+    Chord        // Several buttons pressed together
+};
+
+struct Gesture
+{
+    GestureType type;
+    uint8_t buttons; // Button mask
+    uint16_t count;  // Repeat number (Repeat only)
+    uint32_t ms;     // When it was recognized
+};
+
+struct GestureTimings
+{
+    uint16_t doubleClickMs;
+    uint16_t longPressMs;
+    uint16_t repeatMs;
+    uint16_t chordMs;
+};
+
+class Gestures
+{
+  public:
+    Gestures();
+
+    void begin();
+
+    // Feeds one debounced button event (loop task)
+    void feed(const ButtonEvent &ev);
+
+    // Next recognized gesture, false if none
+    bool next(Gesture &g);
+
+    void setTimings(const GestureTimings &timings);
+    GestureTimings getTimings() const;
+
+    // Buttons that can double click. Others report a click right on release.
+    void setDoubleClickMask(uint8_t mask);
+
+  private:
+    enum class Phase : uint8_t
+    {
+        Idle,
+        Down,     // First press held
+        Up,       // Released, waiting for a second press
+        Long,     // Long press held, repeating
+        Consumed  // Part of a finished gesture, waiting for release
+    };
+
+    struct TimerArg
+    {
+        Gestures *self;
+        uint8_t button;
+    };
+
+    Phase _phase[ButtonConfig::COUNT];
+    uint32_t _downMs[ButtonConfig::COUNT];
+    uint32_t _deadline[ButtonConfig::COUNT]; // When the armed timer should fire
+    uint16_t _repeats[ButtonConfig::COUNT];
+    TimerArg _timerArgs[ButtonConfig::COUNT];
+    TimerHandle_t _timers[ButtonConfig::COUNT];
+
+    GestureTimings _timings;
+    uint8_t _doubleMask;
+
+    QueueHandle_t _queue;
+    SemaphoreHandle_t _mtx; // Loop task feeds, timer task times out
+
+    // Private helpers (with _mtx held)
+    void _arm(uint8_t button, uint32_t ms);
+    void _disarm(uint8_t button);
+    void _emit(GestureType type, uint8_t buttons, uint16_t count = 0);
+    static void _onTimer(TimerHandle_t timer);
+};
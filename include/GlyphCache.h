@@ -0,0 +1,57 @@
+#pragma once
+#include <Arduino.h>
+#include <TFT_eSPI.h>
+
+// GlyphCache.h
+// The clock digits, pre-rendered. Scaled TFT_eSPI fonts are drawn pixel by pixel, so the
+// digits 0-9, colon and blank are rasterized once into 1 bpp bitmaps and then copied out: to
+// the panel as one address window filled by a block write per run of same coloured pixels, or
+// straight into a 16 bit sprite buffer. Font 7 has no antialiasing, one bit per pixel is exact.
+
+namespace GlyphCacheConfig
+{
+constexpr char GLYPHS[] = "0123456789: ";
+constexpr uint8_t NUM_GLYPHS = sizeof(GLYPHS) - 1;
+constexpr size_t MAX_BYTES = 9216; // Font 7 at size 2 takes about 8.3 KB
+} // namespace GlyphCacheConfig
+
+class GlyphCache
+{
+  public:
+    GlyphCache(TFT_eSPI &tft);
+
+    // Rasterizes the glyphs unless font, size and colours are the ones already cached.
+    // False if they don't fit, draw with the font then.
+    bool build(uint8_t font, uint8_t size, uint16_t fg, uint16_t bg);
+    bool ready() const;
+
+    int16_t width(char c) const; // 0 if not cached. Blank is as wide as the colon.
+    int16_t height() const;
+    size_t bytes() const; // Bitmap storage in use
+
+    // Panel, inside a write batch (startWrite)
+    void blit(int16_t x, int16_t y, char c);
+
+    // 16 bit sprite, clipped to it
+    void blit(TFT_eSprite &spr, int16_t x, int16_t y, char c);
+
+  private:
+    TFT_eSPI &_tft;
+
+    uint8_t _bits[GlyphCacheConfig::MAX_BYTES]; // Rows MSB first, padded to whole bytes
+    uint16_t _offset[GlyphCacheConfig::NUM_GLYPHS];
+    int16_t _width[GlyphCacheConfig::NUM_GLYPHS];
+    int16_t _height;
+    size_t _bytes;
+
+    // What the cache was built for
+    bool _ready;
+    uint8_t _font;
+    uint8_t _size;
+    uint16_t _fg;
+    uint16_t _bg;
+
+    // Private helpers
+    int8_t _index(char c) const;
+    void _render(uint8_t idx, TFT_eSprite &scratch);
+};
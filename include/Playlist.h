@@ -0,0 +1,58 @@
+#pragma once
+#include <Arduino.h>
+
+// Playlist.h
+// Shuffled play order for one track category. Every track plays once before any
+// repeats, and the order and position survive reboots (saved in flash).
+
+namespace PlaylistConfig
+{
+constexpr uint8_t MAX_TRACKS = 64;    // Larger categories fall back to plain random picks
+constexpr uint8_t DEFAULT_WEIGHT = 1; // 0 = never plays, higher plays earlier in each cycle
+constexpr uint8_t MAX_WEIGHT = 9;
+} // namespace PlaylistConfig
+
+class Playlist
+{
+  public:
+    Playlist();
+
+    // Binds the playlist to a category and loads its saved order.
+    // Reshuffles if the category's track count changed since it was saved.
+    void begin(uint8_t id, uint8_t trackCount);
+    bool isBound(uint8_t trackCount) const;
+
+    // Returns the next track (1-based), reshuffling when the cycle is used up. 0 if nothing can play.
+    uint8_t next();
+
+    // Starts a fresh cycle
+    void reshuffle();
+
+    bool setWeight(uint8_t track, uint8_t weight);
+    uint8_t getWeight(uint8_t track) const;
+
+    uint8_t remaining() const; // Tracks left before the next reshuffle
+    uint8_t length() const;    // Tracks per cycle (weight > 0)
+
+  private:
+    // Saved to flash as one blob per category
+    struct State
+    {
+        uint8_t count;  // Category track count the order was built for
+        uint8_t length; // Entries used in order
+        uint8_t cursor; // Next entry to play
+        uint8_t last;   // Last track played, never first in the next cycle
+        uint8_t order[PlaylistConfig::MAX_TRACKS];
+    };
+
+    uint8_t _id;
+    bool _bound;
+    State _state;
+    uint8_t _weights[PlaylistConfig::MAX_TRACKS];
+
+    // Private helpers
+    void _shuffle();
+    void _save();
+    void _saveWeights();
+    bool _load();
+};
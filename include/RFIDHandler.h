@@ -1,26 +1,89 @@
 #pragma once
+#include "Config.h"
+#include "SpiBus.h"
 #include <Arduino.h>
 #include <MFRC522.h>
+#include <functional>
 
 // RFIDHandler.h
-// RFID hardware abstraction layer for simpler card reading and ID
+// RFID hardware abstraction layer for simpler card reading and ID.
+// Cards are detected through the RC522 IRQ line: the reader is sent a REQA now and then and
+// interrupts only when a card answers, so the host reads nothing until a card is in the field.
+// Without a working IRQ line it falls back to timed polling.
+// Full rate only while an alarm rings or is about to, slow (or powered down) otherwise.
+
+namespace RFIDConfig
+{
+constexpr uint32_t KICK_PERIOD_MS = 100;   // REQA period in IRQ mode (card detect latency)
+constexpr uint16_t DEFAULT_POLL_MS = 100;  // Card check period in polling mode (see Settings.h)
+constexpr uint32_t IRQ_TEST_MS = 50;       // Wait for the reader's timeout interrupt at startup
+
+// Scheduling around alarms
+constexpr uint32_t ACTIVE_LEAD_MS = 2 * 60 * 1000UL; // Full rate this long before an alarm
+constexpr uint16_t DEFAULT_IDLE_MS = 1000;           // Period otherwise (see Settings.h, 0 = power down)
+
+// RC522 interrupt setup
+constexpr uint8_t COM_IEN_RX = 0xA0;       // ComIEnReg: IRQ active low, receive interrupt
+constexpr uint8_t COM_IEN_TIMER = 0x81;    // ComIEnReg: IRQ active low, timer interrupt (self-test)
+constexpr uint8_t DIV_IEN_PUSH_PULL = 0x80; // DivIEnReg: IRQ pin push-pull
+constexpr uint8_t COM_IRQ_CLEAR = 0x7F;    // ComIrqReg: clear all request bits
+constexpr uint8_t FIFO_FLUSH = 0x80;       // FIFOLevelReg: empty the FIFO
+constexpr uint8_t BIT_FRAMING_START = 0x87; // BitFramingReg: StartSend, 7 bit REQA frame
+} // namespace RFIDConfig
+
+enum class RFIDMode : uint8_t
+{
+    Irq, // Periodic REQA, card answer raises the IRQ line
+    Poll // Full card check every poll period
+};
 
 class RFIDHandler
 {
   public:
-    RFIDHandler(MFRC522 &rfid);
+    RFIDHandler(MFRC522 &rfid, SpiDevice &spi, uint8_t irqPin = Pins::RFID_IRQ_PIN);
+
+    // Sets up the reader's interrupt output and checks the IRQ line, falling back to polling
+    // if it never fires. Call after PCD_Init().
+    void begin();
 
     void poll();
-    void getCardUID(char out[64]);
+
+    RFIDMode getMode() const;
+
+    // Alarm state from alarm events: full rate while ringing and from ACTIVE_LEAD_MS before
+    // the next alarm, idle rate (or soft power-down) otherwise
+    void setAlarmState(bool ringing, bool scheduled, uint32_t msUntilAlarm);
+    bool isActive() const;
 
     //========== Callbacks ==========
-    using RFIDCallback = std::function<void(const char*)>;
+    using RFIDCallback = std::function<void(const uint8_t *uid, uint8_t len)>;
     // Registers a callback when the RFID scanner detects a card,
-    // passes card UID as argument
+    // passes the raw card UID bytes as argument
     void onRFIDEvent(RFIDCallback cb) { _onRFIDEvent = cb; }
 
   private:
     MFRC522 &_rfid;
+    SpiDevice &_spi; // Held for every reader exchange and schedule change (setAlarmState comes from the alarm, command and loop tasks)
+    uint8_t _irqPin;
+
+    RFIDMode _mode;
+    volatile bool _irq;
+    unsigned long _lastKick;
+
+    // Scheduling
+    bool _active;             // Full rate
+    bool _poweredDown;        // RC522 in soft power-down
+    bool _activatePending;    // Go active at _activateAt
+    unsigned long _activateAt;
+
+    MFRC522::Uid _uid; // Card read by _check(), reported once the bus is released
 
     RFIDCallback _onRFIDEvent;
-};
\ No newline at end of file
+
+    // Private helpers
+    void _setActive(bool active);
+    bool _check(unsigned long now);
+    void _kick();
+    void _readCard();
+    static void IRAM_ATTR _onIRQ(void *arg);
+};
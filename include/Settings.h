@@ -0,0 +1,91 @@
+#pragma once
+#include <Arduino.h>
+#include <Preferences.h>
+#include <functional>
+
+// Settings.h
+// Persistent typed runtime settings. Values live in RAM, changes are batched into
+// one flash write after SettingsConfig::FLUSH_DELAY_MS without further changes.
+
+namespace SettingsConfig
+{
+constexpr uint16_t SCHEMA_VERSION = 1;   // Bump and add a step to Settings::_migrate() when keys change
+constexpr uint32_t FLUSH_DELAY_MS = 3000; // Quiet time before dirty settings are written
+} // namespace SettingsConfig
+
+// Setting ids, index into the definition table in Settings.cpp
+enum class Setting : uint8_t
+{
+    WiFiPersistent, // Keep WiFi connected between syncs
+    Volume,         // Player volume outside of alarms
+    WakeRampMin,    // Minutes the alarm starts early, ramping up volume
+    WakeRampSync,   // Backlight ramps along with the wake ramp
+    AmbientRiseMs,  // Ambient light smoothing time constant when getting brighter
+    AmbientFallMs,  // ... and when getting darker
+    DisplayDimSec,  // Seconds without input before the display dims (dark room or night)
+    NightStart,     // Minute of day the display may turn off in the dark
+    NightEnd,       // ... and the minute it stays on again
+    LongPressMs,    // Button hold time for a long press
+    DoubleClickMs,  // Max gap between the clicks of a double click
+    RfidPollMs,     // Card check period when the RFID IRQ line isn't used
+    RfidIdleMs,     // Card check period away from alarms (0 = reader powered down)
+    Count
+};
+
+enum class SettingType : uint8_t
+{
+    Bool,
+    U8,
+    U16,
+    I32,
+    U32
+};
+
+class Settings
+{
+  public:
+    Settings();
+
+    // Loads all settings from flash, migrating older layouts. Does not log (runs before LOG.begin).
+    void begin();
+
+    // Writes pending changes once they have settled. Called every loop.
+    void run();
+    void flush();
+
+    int32_t get(Setting id) const;
+    bool getBool(Setting id) const { return get(id) != 0; }
+
+    // Validates against the setting's range. Returns false (and changes nothing) if out of range.
+    bool set(Setting id, int32_t value);
+    void reset(Setting id); // Back to default
+
+    // Lookup by name for the command interface
+    bool find(const char *name, Setting &id) const;
+    const char *name(Setting id) const;
+    SettingType type(Setting id) const;
+    void range(Setting id, int32_t &min, int32_t &max) const;
+
+    //========== Callbacks ==========
+    using ChangeCallback = std::function<void(int32_t value)>;
+    // Registers a callback when a setting changes value (one per setting), called from the setter's task
+    void onChange(Setting id, ChangeCallback cb);
+
+  private:
+    static constexpr uint8_t COUNT = (uint8_t)Setting::Count;
+
+    int32_t _values[COUNT];
+    uint32_t _dirty; // Bit per setting
+    unsigned long _lastChange;
+    ChangeCallback _onChange[COUNT];
+
+    Preferences _prefs;
+    mutable SemaphoreHandle_t _mtx; // Mutex safety
+
+    // Private helpers
+    void _migrate(uint16_t from);
+    void _write(uint8_t idx);
+};
+
+// Universal settings object access
+extern Settings SETTINGS;
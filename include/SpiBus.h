@@ -0,0 +1,114 @@
+#pragma once
+#include <Arduino.h>
+#include <functional>
+
+// SpiBus.h
+// Arbitration for the shared VSPI bus (TFT and RFID reader). Every device gets a handle with its
+// own clock and mode. A device lock serializes whole operations across tasks, so a UI redraw is
+// never cut into by an RFID exchange from another task. Devices with a batch hook (TFT_eSPI
+// startWrite/endWrite) run each locked operation as one SPI transaction instead of one per
+// primitive. Bus time is accounted per device.
+
+namespace SpiBusConfig
+{
+constexpr uint8_t MAX_DEVICES = 4;
+constexpr uint32_t TFT_HZ = 27000000; // SPI_FREQUENCY in User_Setup.h
+constexpr uint32_t RFID_HZ = 4000000; // MFRC522 library clock
+} // namespace SpiBusConfig
+
+class SpiBus;
+
+class SpiDevice
+{
+  public:
+    using BatchHook = std::function<void()>;
+
+    // Registers with the bus, construct after it
+    SpiDevice(SpiBus &bus, const char *name, uint32_t hz, uint8_t mode);
+
+    // Opens/closes one transaction around a whole locked operation
+    void setBatch(BatchHook begin, BatchHook end);
+
+    // Holds the bus for this device while in scope. Nests, also inside another device's lock
+    // in the same task (that device's batch is closed and reopened around it).
+    class Lock
+    {
+      public:
+        explicit Lock(SpiDevice &dev);
+        ~Lock();
+
+      private:
+        SpiDevice &_dev;
+        SpiDevice *_prev; // Device that held the bus before, NULL if none
+
+        Lock(const Lock &) = delete;
+        Lock &operator=(const Lock &) = delete;
+    };
+
+    struct Stats
+    {
+        uint32_t operations; // Times the device took the bus
+        uint64_t busyUs;     // Time holding the bus
+        uint64_t waitUs;     // Time blocked waiting for another task
+    };
+    Stats getStats() const;
+
+    const char *name() const { return _name; }
+    uint32_t hz() const { return _hz; }
+    uint8_t mode() const { return _mode; }
+
+  private:
+    friend class SpiBus;
+
+    SpiBus &_bus;
+    const char *_name;
+    uint32_t _hz;
+    uint8_t _mode;
+
+    BatchHook _batchBegin;
+    BatchHook _batchEnd;
+
+    // Bus time, written with the bus lock held
+    uint32_t _operations;
+    uint64_t _busyUs;
+    uint64_t _waitUs;
+    int64_t _since; // When it last took the bus
+};
+
+class SpiBus
+{
+  public:
+    SpiBus();
+
+    // Creates the bus lock. Call before the first device operation.
+    void begin();
+
+    uint8_t deviceCount() const;
+    const SpiDevice *device(uint8_t idx) const;
+
+    // Switches between devices with a different clock or mode (settings re-applied by the driver)
+    uint32_t getReconfigs() const;
+
+    // Time since begin(), the reference for per-device occupancy
+    uint64_t uptimeUs() const;
+
+  private:
+    friend class SpiDevice;
+
+    SpiDevice *_devices[SpiBusConfig::MAX_DEVICES];
+    uint8_t _count;
+
+    SpiDevice *_current; // Holds the bus now
+    SpiDevice *_last;    // Held it last, for counting reconfigs
+    uint32_t _reconfigs;
+    int64_t _beginUs;
+
+    SemaphoreHandle_t _mtx; // Recursive, any task
+
+    // Private helpers
+    void _add(SpiDevice *dev);
+    SpiDevice *_acquire(SpiDevice &dev);
+    void _release(SpiDevice &dev, SpiDevice *prev);
+    void _enter(SpiDevice *dev, int64_t now);
+    void _leave(SpiDevice *dev, int64_t now);
+};
@@ -0,0 +1,82 @@
+#pragma once
+#include "AudioPlayer.h"
+#include "Playlist.h"
+#include <Arduino.h>
+#include <Preferences.h>
+
+// TrackCatalog.h
+// SD card track discovery. Categories are the card's numbered folders (see Config.h),
+// per-folder file counts are queried from the DFPlayer and cached in flash per card. The card
+// totals can't tell a file moved between folders, so the first time a folder plays after boot
+// its cached count is queried again in the background, for the plays after it.
+
+namespace TrackConfig
+{
+constexpr uint8_t MAX_CATEGORIES = 16; // Folders 01-16 are scanned
+
+// Category 0 is every file on the card (played by index), the only category on a card without folders
+constexpr uint8_t ALL = 0;
+
+// Folder layout of the stock card
+constexpr uint8_t BUZZERS = 1;
+constexpr uint8_t NORMAL_SONGS = 2;
+constexpr uint8_t LOUD_SONGS = 3;
+constexpr uint8_t DEFAULT_SOUND = BUZZERS; // Alarms play it (at random) when their category plays nothing
+
+// How a category picks its next track
+constexpr uint8_t SHUFFLE = 0; // Saved shuffled playlist, no repeats until every track has played
+constexpr uint8_t RANDOM = 1;  // Independent random pick each time
+} // namespace TrackConfig
+
+class TrackCatalog
+{
+  public:
+    TrackCatalog(AudioPlayer &player);
+
+    // Loads the cached catalog, or scans the card if it changed. Needs the audio task running.
+    void begin();
+
+    // Queries every folder again and replaces the cache. Returns false if the player didn't answer.
+    bool rescan();
+
+    uint8_t categoryCount() const;                // Folders found (0 on a root-only card)
+    uint16_t trackCount(uint8_t category) const; // Files in a category, 0 if unknown
+    bool fromCache() const;                       // Whether begin() skipped the scan
+
+    // Plays a track of a category (track 0 = next by mode). Empty categories fall back to ALL.
+    // False if nothing played, also when every track of a shuffled category has weight 0.
+    bool play(uint8_t category, uint16_t track = 0, uint8_t mode = TrackConfig::SHUFFLE);
+
+    // Shuffled playlist of a category. All false if it has no tracks or too many to shuffle.
+    struct PlaylistInfo
+    {
+        uint8_t remaining; // Tracks left this cycle
+        uint8_t length;    // Tracks per cycle
+        uint8_t count;     // Tracks in the category
+        uint8_t weights[PlaylistConfig::MAX_TRACKS];
+    };
+    bool playlistInfo(uint8_t category, PlaylistInfo &out);
+    bool reshuffle(uint8_t category);
+    bool setWeight(uint8_t category, uint8_t track, uint8_t weight); // Also false for a bad track/weight
+
+  private:
+    AudioPlayer &_player;
+    Preferences _prefs;
+
+    uint16_t _totalFiles;
+    uint8_t _folderCount;
+    uint8_t _counts[TrackConfig::MAX_CATEGORIES + 1]; // index = folder number, [0] unused
+    bool _fromCache;
+    uint32_t _checked; // Folders whose cached count was queried since boot, bit = folder number
+
+    Playlist _playlists[TrackConfig::MAX_CATEGORIES + 1]; // index = category
+    SemaphoreHandle_t _mtx;                               // Alarm task and loop both play tracks
+
+    // Private helpers
+    Playlist *_playlist(uint8_t category); // With _mtx held
+    static uint32_t _fingerprint(int files, int folders);
+    void _checkCount(uint8_t folder);
+    void _onFolderCount(uint8_t folder, int n);
+    bool _load(uint32_t fingerprint);
+    void _save(uint32_t fingerprint);
+};
@@ -1,15 +1,45 @@
 #pragma once
 #include "AlarmSystem.h"
+#include "Animation.h"
 #include "Buttons.h"
 #include "Config.h"
+#include "DisplayPower.h"
 #include "NetworkManager.h"
+#include "SpiBus.h"
 #include "Timekeeper.h"
+#include "Widgets.h"
 #include <RTClib.h>
 #include <TFT_eSPI.h>
+#include <atomic>
 #include <functional>
 
 // UI.h
-// Display updates and functions
+// Display updates and functions. A render task on core 0 owns the panel: the public functions
+// only hand it new data and return, so no caller waits on SPI transfers. Data updates go to
+// one-slot mailboxes that keep only the latest value, everything else through a bounded queue
+// in order. Effects are timeline animations (Animation.h) the render task advances at a frame
+// rate while any of them runs. The clock screen is a set of retained widgets (Widgets.h). Each
+// frame repaints only the areas whose data changed, off-screen into sprites pushed by DMA when
+// available, so nothing is erased on the panel before it is redrawn.
+
+namespace UIConfig
+{
+constexpr uint8_t MAX_DAMAGE = 20; // Damaged areas per frame (time cells + other widgets + overlays)
+
+// Animations
+constexpr uint16_t FRAME_MS = 33;        // Frame period while an animation runs
+constexpr uint16_t ALARM_BLINK_MS = 500; // Alarm line while ringing
+constexpr uint16_t SLIDE_MS = 300;       // New weather sliding in
+
+// Render task
+constexpr uint8_t QUEUE_LENGTH = 16; // Ordered requests waiting for the render task
+constexpr uint32_t TASK_STACK = 4096;
+constexpr UBaseType_t TASK_PRIORITY = 1;
+constexpr BaseType_t TASK_CORE = 0; // Off the loop's core
+constexpr uint8_t PRINT_LEN = 48;   // Boot console line, including terminator
+
+constexpr uint32_t BENCH_TIMEOUT_MS = 5000; // Longest a benchmark caller waits
+} // namespace UIConfig
 
 enum class State
 {
@@ -21,8 +51,9 @@ enum class State
 class UI
 {
   public:
-    UI(TFT_eSPI &tft, Buttons &btn, Timekeeper &tk, NetworkManager &net);
+    UI(TFT_eSPI &tft, SpiDevice &spi, Buttons &btn, Timekeeper &tk, NetworkManager &net);
 
+    // Draws the boot banner, allocates sprites and DMA and starts the render task
     bool begin();
 
     void run();
@@ -30,8 +61,12 @@ class UI
     void setState(State state);
     State getState() const;
 
+    // Display power changes: no drawing while dark, repaint on wake, minute updates in idle mode
+    void setPowerState(PowerState power);
+
     // Boot state functions
     bool displayStartupStatus(bool rtcOK, bool rtcLostPower, bool playerOK, bool rfidOK);
+    void print(const char *text, uint16_t color = Colors::TEXT_COLOR); // Boot console text
 
     // Clock state functions
     void drawClockScreen(const DateTime &time, const WeatherData &weather);
@@ -41,36 +76,142 @@ class UI
     void updateWeatherDisplay(const WeatherData &weather);
     void updateAlarmDisplay();
 
-    void handleClockButtonIn();
+    // Bytes sent to the panel since boot (pixel data, 2 bytes per pixel)
+    uint32_t getBytesPushed() const;
+    uint32_t getDroppedRequests() const; // Queue was full
+    uint32_t getCoalesced() const;       // Data updates replaced by a newer one before drawing
+    uint32_t getFrames() const;          // Frames that repainted something
+    bool usesDMA() const;
+
+    // Draws "HH:MM" over the time runs times, once with the font and once from the glyph cache.
+    // A diagnostic, the only call that waits for the render task. Per draw times in us, cached 0
+    // if there is no cache.
+    struct TimeBenchmark
+    {
+        uint16_t runs;
+        uint32_t fontUs;
+        uint32_t cachedUs;
+        uint32_t cacheBytes;
+    };
+    bool benchmarkTime(uint16_t runs, TimeBenchmark &out);
 
-    // Helpers
-    void drawCenteredString(const char text[],
-                            uint16_t textColor = Colors::TEXT_COLOR,
-                            uint16_t bgColor = Colors::BACKGROUND_COLOR,
-                            uint8_t font = 1,
-                            uint8_t size = 2);
+    // Helpers, non-blocking. A new flash or fade replaces the running one.
     void flashScreen(uint16_t flashColor, int flashDuration = 150);
+    void fadeScreen(uint16_t from, uint16_t to, int duration, Ease curve = Ease::InOut);
+    void cancelEffects(); // Ends flash/fade now, the screen underneath comes back
 
-    // For recieving alarm data from callback
-    struct AlarmDisplayData
-    {
-        uint8_t hour;
-        uint8_t minute;
-        bool enabled;
-        bool ringing;
-    };
+    // For recieving alarm and status data from callbacks
+    using AlarmDisplayData = ::AlarmDisplayData;
 
     // Callbacks
     using AlarmDataCallback = std::function<AlarmDisplayData()>;
     void setAlarmDataCallback(AlarmDataCallback cb);
+    using StatusDataCallback = std::function<StatusData()>; // Sampled once a second
+    void setStatusDataCallback(StatusDataCallback cb);
 
   private:
+    enum class DrawOp : uint8_t
+    {
+        Lost,    // Boot state reached after boot
+        Clock,   // Clear and show the clock screen (unixtime + weather)
+        Repaint, // Show the clock screen over retained panel contents (unixtime)
+        // Data updates, latest only (one mailbox each, in this order)
+        Time,    // unixtime + colon
+        Date,    // unixtime
+        Weather, // weather
+        Alarm,   // alarm
+        Status,  // status
+        // Drawn in order
+        Animate, // anim
+        Cancel,  // id
+        Bench,   // runs
+        Startup, // startup
+        Print    // text + color
+    };
+
+    struct StartupStatus
+    {
+        bool rtcOK;
+        bool rtcLostPower;
+        bool playerOK;
+        bool rfidOK;
+    };
+
+    struct DrawRequest
+    {
+        DrawOp op;
+        bool colon;
+        uint16_t color;
+        uint16_t id;
+        uint32_t unixtime;
+        union
+        {
+            WeatherData weather;
+            AlarmDisplayData alarm;
+            StatusData status;
+            StartupStatus startup;
+            Animation anim;
+            uint16_t runs;
+            char text[UIConfig::PRINT_LEN];
+        };
+    };
+
     TFT_eSPI &_tft;
-    State _state;
+    SpiDevice &_spi; // Held for every frame (DisplayPower also sends panel commands)
+    volatile State _state;
+    volatile bool _drawing;  // Panel visible, drawing allowed
+    volatile bool _lowPower; // Idle mode, skip the blinking colon
 
     Buttons &_btn;
     Timekeeper &_tk;
     NetworkManager &_net;
 
     AlarmDataCallback _alarmDataCb;
-};
\ No newline at end of file
+    StatusDataCallback _statusDataCb;
+
+    // Clock screen, back to front (render task only)
+    WeatherWidget _weatherWidget;
+    AlarmWidget _alarmWidget;
+    DateWidget _dateWidget;
+    StatusWidget _statusWidget;
+    TimeWidget _timeWidget;
+    Widget *const _widgets[5];
+    bool _clearPending; // Panel shows something else, clear before the next frame
+
+    enum : uint16_t
+    {
+        SCREEN_EFFECT = 1, // Flash or fade
+        ALARM_BLINK,
+        WEATHER_SLIDE
+    };
+    Animator _anim; // Render task only
+
+    TimeBenchmark _bench;
+    SemaphoreHandle_t _benchDone;
+
+    uint32_t _bytesPushed;
+    std::atomic<uint32_t> _dropped;   // Counted by the calling tasks and the render task
+    std::atomic<uint32_t> _coalesced; // Counted by the calling tasks
+    uint32_t _frames;
+    bool _dma; // Sprite pushes by DMA
+
+    static constexpr uint8_t MAILBOXES = 5; // DrawOp::Time to DrawOp::Status
+    QueueHandle_t _queue;
+    QueueHandle_t _mailbox[MAILBOXES]; // Length 1, overwritten
+    TaskHandle_t _task;
+
+    // Private helpers
+    void _post(DrawRequest &req);
+    static int8_t _mailboxFor(DrawOp op); // -1 if the request is drawn in order
+    static void _taskEntry(void *arg);
+    void _apply(const DrawRequest &req); // Render task (or caller before the task runs)
+    void _renderFrame();
+    void _repaint(const Region &area, Widget *owner);
+    void _push(TFT_eSprite &sprite, const Region &area);
+    void _runBenchmark(uint16_t runs);
+
+    // Boot screen drawing
+    void _drawLost(const DateTime &time);
+    void _drawStartupStatus(const StartupStatus &s);
+    void _drawCenteredString(const char text[], uint16_t textColor, uint16_t bgColor, uint8_t font, uint8_t size);
+};
@@ -0,0 +1,178 @@
+#pragma once
+#include "Config.h"
+#include "GlyphCache.h"
+#include "NetworkManager.h"
+#include <Arduino.h>
+#include <RTClib.h>
+#include <TFT_eSPI.h>
+
+// Widgets.h
+// Retained-mode clock screen elements. Each widget keeps the data it shows, marks itself dirty
+// only when that data changes and reports the screen areas it damaged. UI repaints just those
+// areas, drawing every widget that overlaps them back to front.
+
+struct Region
+{
+    int16_t x, y, w, h;
+
+    bool intersects(const Region &o) const
+    {
+        return x < o.x + o.w && o.x < x + w && y < o.y + o.h && o.y < y + h;
+    }
+    bool contains(const Region &o) const
+    {
+        return o.x >= x && o.y >= y && o.x + o.w <= x + w && o.y + o.h <= y + h;
+    }
+    Region clipTo(const Region &o) const; // Overlap, callers check intersects() first
+    Region merge(const Region &o) const;  // Bounding box of both
+};
+
+namespace WidgetConfig
+{
+// Time, font 7 (7 segment) at size 2, centered
+constexpr uint8_t TIME_FONT = 7;
+constexpr uint8_t TIME_SIZE = 2;
+constexpr uint8_t TIME_CELLS = 5; // "HH:MM"
+constexpr uint8_t COLON_CELL = 2;
+
+constexpr Region DATE_REGION = {2, 16, 60, 8};       // "MM/DD/YYYY", font 1
+constexpr Region STATUS_REGION = {214, 16, 100, 8};  // Right aligned to x 314
+constexpr Region WEATHER_REGION = {0, 204, 192, 36}; // Temperature line and description
+constexpr Region ALARM_REGION = {194, 224, 120, 8};  // Right aligned to x 314
+} // namespace WidgetConfig
+
+// Alarm widget data
+struct AlarmDisplayData
+{
+    uint8_t hour;
+    uint8_t minute;
+    bool enabled;
+    bool ringing;
+};
+
+// Status widget data
+struct StatusData
+{
+    bool wifi;      // Connected
+    bool enrolling; // Next scanned card gets enrolled
+};
+
+class Widget
+{
+  public:
+    Widget(TFT_eSPI &tft, const Region &bounds);
+    virtual ~Widget() {}
+
+    // Allocates the off-screen canvas, false if it didn't fit (drawn on the panel instead)
+    virtual bool begin();
+
+    const Region &bounds() const { return _bounds; }
+    bool isDirty() const { return _dirty; }
+    virtual void invalidate() { _dirty = true; }
+
+    // Set by animations. Content shifted by an offset stays clipped to the bounds.
+    void setOffset(int16_t dx, int16_t dy);
+    void setVisible(bool visible);
+    int16_t offsetX() const { return _offsetX; }
+    int16_t offsetY() const { return _offsetY; }
+    bool isVisible() const { return _visible; }
+
+    // Areas changed since the last frame (the whole bounds by default), reset by clean()
+    virtual uint8_t damage(Region *out, uint8_t max) const;
+    virtual void clean() { _dirty = false; }
+
+    // Off-screen buffer exactly the size of a damaged area, NULL if there is none
+    virtual TFT_eSprite *canvas(const Region &area);
+
+    // Draws the widget with its top left corner at (ox, oy). Only the part inside clip (screen
+    // coordinates) has to come out right.
+    virtual void draw(TFT_eSPI &gfx, int16_t ox, int16_t oy, const Region &clip) = 0;
+
+  protected:
+    TFT_eSprite _canvas;
+    Region _bounds;
+    bool _dirty;
+    int16_t _offsetX;
+    int16_t _offsetY;
+    bool _visible;
+};
+
+// "HH:MM", damaged per glyph cell, drawn from the glyph cache
+class TimeWidget : public Widget
+{
+  public:
+    TimeWidget(TFT_eSPI &tft);
+
+    bool begin() override; // Lays the cells out from font metrics and builds the glyph cache
+
+    GlyphCache &glyphs() { return _glyphs; }
+
+    void set(uint8_t hour, uint8_t minute, bool colon);
+
+    void invalidate() override;
+    uint8_t damage(Region *out, uint8_t max) const override;
+    void clean() override;
+    TFT_eSprite *canvas(const Region &area) override;
+    void draw(TFT_eSPI &gfx, int16_t ox, int16_t oy, const Region &clip) override;
+
+  private:
+    TFT_eSPI &_tft;
+    TFT_eSprite _digitCell; // One digit, reused for each damaged digit
+    TFT_eSprite _colonCell;
+    GlyphCache _glyphs;
+
+    int16_t _cellX[WidgetConfig::TIME_CELLS]; // Relative to the bounds
+    int16_t _cellW[WidgetConfig::TIME_CELLS];
+    char _text[WidgetConfig::TIME_CELLS + 1]; // ' ' = hidden colon
+    char _shown[WidgetConfig::TIME_CELLS];    // On the panel, '\0' = unknown
+
+    Region _cell(uint8_t i) const;
+};
+
+class DateWidget : public Widget
+{
+  public:
+    DateWidget(TFT_eSPI &tft);
+
+    void set(const DateTime &date);
+    void draw(TFT_eSPI &gfx, int16_t ox, int16_t oy, const Region &clip) override;
+
+  private:
+    char _text[12];
+};
+
+class WeatherWidget : public Widget
+{
+  public:
+    WeatherWidget(TFT_eSPI &tft);
+
+    void set(const WeatherData &weather);
+    void draw(TFT_eSPI &gfx, int16_t ox, int16_t oy, const Region &clip) override;
+
+  private:
+    WeatherData _weather;
+};
+
+class AlarmWidget : public Widget
+{
+  public:
+    AlarmWidget(TFT_eSPI &tft);
+
+    void set(const AlarmDisplayData &alarm);
+    void draw(TFT_eSPI &gfx, int16_t ox, int16_t oy, const Region &clip) override;
+
+  private:
+    AlarmDisplayData _alarm;
+};
+
+class StatusWidget : public Widget
+{
+  public:
+    StatusWidget(TFT_eSPI &tft);
+
+    void set(const StatusData &status);
+    void draw(TFT_eSPI &gfx, int16_t ox, int16_t oy, const Region &clip) override;
+
+  private:
+    StatusData _status;
+};
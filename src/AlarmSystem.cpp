@@ -1,82 +1,467 @@
 #include "AlarmSystem.h"
 #include "Config.h"
+#include "Settings.h"
 #include <Wire.h>
+#include <algorithm>
+
+using namespace AlarmConfig;
+
+// Minute of the week (Sunday 00:00 = 0) for a point in time
+static uint16_t minuteOfWeek(const DateTime &t)
+{
+    return t.dayOfTheWeek() * MINUTES_PER_DAY + t.hour() * 60 + t.minute();
+}
+
+// Absolute time of the next occurrence of a schedule minute, strictly after now
+static DateTime nextOccurrence(uint16_t target, const DateTime &now)
+{
+    uint16_t delta = (target + MINUTES_PER_WEEK - minuteOfWeek(now)) % MINUTES_PER_WEEK;
+    if (delta == 0)
+        delta = MINUTES_PER_WEEK;
+
+    DateTime minuteStart(now.year(), now.month(), now.day(), now.hour(), now.minute(), 0);
+    return minuteStart + TimeSpan((int32_t)delta * 60);
+}
 
 // Constructor
-AlarmSystem::AlarmSystem(RTC_DS3231 &rtc, Timekeeper &tk, DFRobotDFPlayerMini &player)
-    : _rtc(rtc), _tk(tk), _player(player), _ringing(false), _alarm({0, 00, false})
+AlarmSystem::AlarmSystem(RTC_DS3231 &rtc, Timekeeper &tk, AudioPlayer &player, TrackCatalog &tracks)
+    : _rtc(rtc), _tk(tk), _player(player), _tracks(tracks), _ringing(false), _eventPending(false), _wakeRampPendingMs(0),
+      _alarmCount(0), _scheduleSize(0), _slotMinute{NO_SLOT, NO_SLOT}, _consumedMinute(NO_SLOT),
+      _ringStage(0), _volume(0), _rampTarget(0),
+      _rampStepVol(1), _waking(false), _stageTimer(NULL), _rampTimer(NULL), _mtx(NULL), _task(NULL)
 {
+    // Unused stages start as copies of stage 0
+    const uint8_t defaults = sizeof(DEFAULT_STAGES) / sizeof(DEFAULT_STAGES[0]);
+    for (uint8_t i = 0; i < MAX_STAGES; i++)
+        _stages[i] = DEFAULT_STAGES[i < defaults ? i : 0];
 }
 
-// Init alarm system using DS3231 hardware alarm
-// Only alarm 1 is used in this implementation (TOFO: Add alarm 2 support)
+// Init alarm system: loads the alarm table, programs both DS3231 hardware alarms
+// and starts the alarm task woken by the DS3231 INT pin
 void AlarmSystem::begin()
 {
-    DateTime rtcAlarm = _rtc.getAlarm1();
-    _alarm.hour = rtcAlarm.hour();
-    _alarm.minute = rtcAlarm.minute();
-    _alarm.enabled = _isRTCAlarmEnabled();
+    _mtx = xSemaphoreCreateMutex();
+    if (!_mtx)
+        LOG.log("Warning! AlarmSystem mutex initialization failed.");
+
+    bool migrated = false;
+    if (!_load(migrated))
+    {
+        // No saved table yet: adopt the single alarm kept in DS3231 alarm 1 by older firmware
+        DateTime rtcAlarm = _rtc.getAlarm1();
+        _alarms[0] = {rtcAlarm.hour(), rtcAlarm.minute(), _isRTCAlarmEnabled(), EVERY_DAY, false, 0};
+        _alarmCount = 1;
+        _save();
+    }
+    else if (migrated)
+        _save(); // Rewrite in the current layout
+
+    // INT/SQW pin in interrupt mode (no square wave)
+    _rtc.writeSqwPinMode(DS3231_OFF);
+
+    _rebuildSchedule();
+    _programRTC();
+
+    // Escalation timers only notify the alarm task, which does all player work
+    _stageTimer = xTimerCreate("AlarmStage", 1, pdFALSE, this, _onTimer);
+    _rampTimer = xTimerCreate("AlarmRamp", 1, pdTRUE, this, _onTimer);
+
+    if (xTaskCreatePinnedToCore(_taskEntry, "AlarmTask", 4096, this, 2, &_task, 1) != pdPASS)
+    {
+        LOG.log("Warning! AlarmSystem task creation failed.");
+        return;
+    }
+
+    pinMode(Pins::RTC_INT_PIN, INPUT_PULLUP);
+    attachInterruptArg(digitalPinToInterrupt(Pins::RTC_INT_PIN), _onRTCInterrupt, this, FALLING);
+
+    // A new ramp window moves the hardware alarms
+    SETTINGS.onChange(Setting::WakeRampMin, [this](int32_t)
+                      { xTaskNotify(_task, NOTIFY_RESCHEDULE, eSetBits); });
+
+    // Track finished events arrive on the audio task
+    _player.onTrackFinished([this](uint16_t)
+                            { xTaskNotify(_task, NOTIFY_TRACK_DONE, eSetBits); });
+
+    // A flag may already be pending from before boot (INT held low, no edge)
+    xTaskNotify(_task, NOTIFY_RTC_INT, eSetBits);
 }
 
+// Delivers alarm task events to the loop task. Does no I2C polling.
 void AlarmSystem::run()
 {
-    if (isAlarmTime())
+    // Event callback (deferred so UI work stays on the loop task)
+    if (_eventPending)
     {
-        _player.volume(normalVol);
-        // Plays random song in track range (default is normal songs)
-        _player.play(random(trackRange.first, trackRange.second + 1));
-        //_player.loop(Tracks::buzzerTrack);
-
-        _alarmMillis = millis(); // Set for snooze alarm
-
-        // Event callback
+        _eventPending = false;
         if (_onAlarmEvent)
             _onAlarmEvent();
     }
 
-    // Snooze alarm: plays another song every 5 minutes until dismissed
-    if (_ringing && _fiveMinutesPassed())
+    // Wake ramp callback (backlight follows the volume ramp)
+    if (_wakeRampPendingMs)
+    {
+        uint32_t ms = _wakeRampPendingMs;
+        _wakeRampPendingMs = 0;
+        if (_onWakeRamp)
+            _onWakeRamp(ms);
+    }
+
+    // Date changes (midnight or a clock adjustment) re-anchor the hardware alarms
+    if (_tk.dayTick() && _task)
+        xTaskNotify(_task, NOTIFY_RESCHEDULE, eSetBits);
+}
+
+//==================== Alarm task ====================
+
+// Sleeps until the DS3231 INT pin, an escalation timer or a dismiss wakes it
+// (or the fallback poll times out), then services alarm flags and escalation
+void AlarmSystem::_taskEntry(void *arg)
+{
+    AlarmSystem *self = static_cast<AlarmSystem *>(arg);
+
+    while (true)
     {
-        _player.volume(25);
-        _player.play(random(Tracks::loudSongs.first, Tracks::loudSongs.second + 1)); // Loud folder
+        uint32_t bits = 0;
+        xTaskNotifyWait(0, UINT32_MAX, &bits, pdMS_TO_TICKS(FALLBACK_POLL_MS));
+
+        if (bits & NOTIFY_DISMISS)
+            self->_stopRinging();
+
+        // Timeout (bits == 0) doubles as the fallback poll
+        uint32_t wakeMs = 0;
+        if (self->_checkFired(wakeMs))
+            self->_enterStage(self->_ringStage, wakeMs);
+        else if (self->_ringing && (bits & NOTIFY_STAGE))
+            self->_enterStage(self->_stages[self->_ringStage].next);
+        else if (self->_ringing && (bits & NOTIFY_RAMP))
+            self->_rampStep();
+
+        // Keep the current stage audible until it escalates or is dismissed
+        if (self->_ringing && (bits & NOTIFY_TRACK_DONE))
+            self->_playStageTrack();
+
+        if (bits & NOTIFY_RESCHEDULE)
+        {
+            xSemaphoreTake(self->_mtx, portMAX_DELAY);
+            self->_programRTC();
+            xSemaphoreGive(self->_mtx);
+        }
     }
 }
 
+// DS3231 INT/SQW falling edge
+void IRAM_ATTR AlarmSystem::_onRTCInterrupt(void *arg)
+{
+    AlarmSystem *self = static_cast<AlarmSystem *>(arg);
+    BaseType_t woken = pdFALSE;
+    xTaskNotifyFromISR(self->_task, NOTIFY_RTC_INT, eSetBits, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+// Escalation timer expiry, runs on the timer service task
+void AlarmSystem::_onTimer(TimerHandle_t timer)
+{
+    AlarmSystem *self = static_cast<AlarmSystem *>(pvTimerGetTimerID(timer));
+    xTaskNotify(self->_task, timer == self->_stageTimer ? NOTIFY_STAGE : NOTIFY_RAMP, eSetBits);
+}
+
+// Starts an escalation stage: plays a track from its category and arms its duration and ramp timers.
+// With a wake ramp, playback starts quietly and reaches the stage volume after wakeMs.
+void AlarmSystem::_enterStage(uint8_t idx, uint32_t wakeMs)
+{
+    if (idx >= MAX_STAGES)
+        idx = 0;
+
+    xSemaphoreTake(_mtx, portMAX_DELAY);
+    EscalationStage stage = _stages[idx];
+    xSemaphoreGive(_mtx);
+
+    _ringStage = idx;
+    uint8_t stageVol = std::min(stage.startVol, VOLUME_CEILING);
+    _waking = wakeMs > 0 && stageVol > WAKE_START_VOL;
+    _volume = _waking ? WAKE_START_VOL : stageVol;
+    _player.volume(_volume);
+    _playTrack(stage);
+
+    // xTimerChangePeriod also (re)starts the timer. Stage duration counts from the alarm time.
+    if (stage.durationSec > 0)
+        xTimerChangePeriod(_stageTimer, pdMS_TO_TICKS(stage.durationSec * 1000UL + wakeMs), 0);
+    else
+        xTimerStop(_stageTimer, 0);
+
+    if (_waking)
+        _startRamp(stageVol, wakeMs);
+    else
+        _startStageRamp();
+}
+
+// Arms the ramp timer to move from the current volume to target over durationMs,
+// taking bigger steps where needed to stay under the volume write rate limit
+void AlarmSystem::_startRamp(uint8_t target, uint32_t durationMs)
+{
+    if (target <= _volume || durationMs == 0)
+    {
+        xTimerStop(_rampTimer, 0);
+        return;
+    }
+
+    uint32_t steps = target - _volume;
+    _rampTarget = target;
+    _rampStepVol = (steps * MIN_RAMP_STEP_MS + durationMs - 1) / durationMs;
+    if (_rampStepVol == 0)
+        _rampStepVol = 1;
+
+    uint32_t periodMs = std::max(durationMs * _rampStepVol / steps, MIN_RAMP_STEP_MS);
+    xTimerChangePeriod(_rampTimer, pdMS_TO_TICKS(periodMs), 0);
+}
+
+// Starts the active stage's own ramp towards the volume ceiling (if it has one)
+void AlarmSystem::_startStageRamp()
+{
+    xSemaphoreTake(_mtx, portMAX_DELAY);
+    uint8_t perMin = _stages[_ringStage].rampPerMin;
+    xSemaphoreGive(_mtx);
+
+    if (perMin > 0 && _volume < VOLUME_CEILING)
+        _startRamp(VOLUME_CEILING, (VOLUME_CEILING - _volume) * 60000UL / perMin);
+    else
+        xTimerStop(_rampTimer, 0);
+}
+
+// Plays another track from the active stage's category
+void AlarmSystem::_playStageTrack()
+{
+    xSemaphoreTake(_mtx, portMAX_DELAY);
+    EscalationStage stage = _stages[_ringStage];
+    xSemaphoreGive(_mtx);
+
+    _playTrack(stage);
+}
+
+// An alarm always makes a sound, even when its category has every track weighted out
+void AlarmSystem::_playTrack(const EscalationStage &stage)
+{
+    if (!_tracks.play(stage.category, stage.track, stage.mode))
+        _tracks.play(TrackConfig::DEFAULT_SOUND, 0, TrackConfig::RANDOM);
+}
+
+// Raises volume by one ramp step. A finished wake ramp hands over to the stage ramp.
+void AlarmSystem::_rampStep()
+{
+    if (_volume < _rampTarget)
+    {
+        _volume = std::min<uint8_t>(_volume + _rampStepVol, _rampTarget);
+        _player.volume(_volume);
+    }
+
+    if (_volume >= _rampTarget)
+    {
+        xTimerStop(_rampTimer, 0);
+        if (_waking)
+        {
+            _waking = false;
+            _startStageRamp();
+        }
+    }
+}
+
+// Stops escalation timers and playback
+void AlarmSystem::_stopRinging()
+{
+    xTimerStop(_stageTimer, 0);
+    xTimerStop(_rampTimer, 0);
+    _waking = false;
+
+    _player.stop();
+    _player.volume(SETTINGS.get(Setting::Volume));
+}
+
+//==================== Alarm table ====================
+
+// Returns the primary alarm (index 0)
 AlarmTime AlarmSystem::getAlarm()
 {
-    return _alarm;
+    AlarmTime a = {0, 0, false, EVERY_DAY, false, 0};
+    getAlarm(0, a);
+    return a;
 }
 
+// Sets time and enable state of the primary alarm, keeping its repeat days
 void AlarmSystem::setAlarm(uint8_t hr, uint8_t min, bool enable)
 {
-    _alarm = {hr, min, enable};
+    AlarmTime a = getAlarm();
+    a.hour = hr;
+    a.minute = min;
+    a.enabled = enable;
 
-    if (enable)
+    if (alarmCount() == 0)
+        addAlarm(a);
+    else
+        setAlarm(0, a);
+}
+
+uint8_t AlarmSystem::alarmCount()
+{
+    xSemaphoreTake(_mtx, portMAX_DELAY);
+    uint8_t n = _alarmCount;
+    xSemaphoreGive(_mtx);
+    return n;
+}
+
+bool AlarmSystem::getAlarm(uint8_t idx, AlarmTime &out)
+{
+    xSemaphoreTake(_mtx, portMAX_DELAY);
+    bool ok = idx < _alarmCount;
+    if (ok)
+        out = _alarms[idx];
+    xSemaphoreGive(_mtx);
+    return ok;
+}
+
+bool AlarmSystem::setAlarm(uint8_t idx, const AlarmTime &alarm)
+{
+    xSemaphoreTake(_mtx, portMAX_DELAY);
+    bool ok = idx < _alarmCount;
+    if (ok)
     {
-        // Re-enable alarm in DS3231
-        _rtc.clearAlarm(1);
-        _rtc.setAlarm1(DateTime(0, 0, 0, hr, min, 0), DS3231_A1_Hour);
+        _alarms[idx] = alarm;
+        _alarms[idx].days &= EVERY_DAY;
+        _commit();
     }
-    else
+    xSemaphoreGive(_mtx);
+
+    // Event callback
+    if (ok && _onAlarmEvent)
+        _onAlarmEvent();
+    return ok;
+}
+
+// Appends an alarm to the table. Returns its index, or -1 if the table is full.
+int AlarmSystem::addAlarm(const AlarmTime &alarm)
+{
+    xSemaphoreTake(_mtx, portMAX_DELAY);
+    int idx = -1;
+    if (_alarmCount < MAX_ALARMS)
     {
-        // Disable alarm in DS3231
-        _rtc.clearAlarm(1);
-        _rtc.disableAlarm(1);
+        idx = _alarmCount++;
+        _alarms[idx] = alarm;
+        _alarms[idx].days &= EVERY_DAY;
+        _commit();
     }
+    xSemaphoreGive(_mtx);
 
     // Event callback
-    if (_onAlarmEvent)
+    if (idx >= 0 && _onAlarmEvent)
         _onAlarmEvent();
+    return idx;
 }
 
-void AlarmSystem::dismissAlarm()
+bool AlarmSystem::removeAlarm(uint8_t idx)
 {
-    _player.stop();
-    _player.volume(PLAYER_VOLUME);
+    xSemaphoreTake(_mtx, portMAX_DELAY);
+    bool ok = idx < _alarmCount;
+    if (ok)
+    {
+        for (uint8_t i = idx; i + 1 < _alarmCount; i++)
+            _alarms[i] = _alarms[i + 1];
+        _alarmCount--;
+        _commit();
+    }
+    xSemaphoreGive(_mtx);
 
-    _rtc.clearAlarm(1);
+    // Event callback
+    if (ok && _onAlarmEvent)
+        _onAlarmEvent();
+    return ok;
+}
+
+// Marks (or unmarks) the next occurrence of an alarm to be skipped
+bool AlarmSystem::skipNext(uint8_t idx, bool skip)
+{
+    xSemaphoreTake(_mtx, portMAX_DELAY);
+    bool ok = idx < _alarmCount;
+    if (ok)
+    {
+        _alarms[idx].skipNext = skip;
+        _save(); // Schedule times are unchanged
+    }
+    xSemaphoreGive(_mtx);
+
+    // Event callback
+    if (ok && _onAlarmEvent)
+        _onAlarmEvent();
+    return ok;
+}
+
+//==================== Escalation table ====================
+
+bool AlarmSystem::getStage(uint8_t idx, EscalationStage &out)
+{
+    xSemaphoreTake(_mtx, portMAX_DELAY);
+    bool ok = idx < MAX_STAGES;
+    if (ok)
+        out = _stages[idx];
+    xSemaphoreGive(_mtx);
+    return ok;
+}
+
+// Replaces a stage. Takes effect the next time the stage is entered.
+bool AlarmSystem::setStage(uint8_t idx, const EscalationStage &stage)
+{
+    if (idx >= MAX_STAGES || stage.next >= MAX_STAGES || stage.category > TrackConfig::MAX_CATEGORIES)
+        return false;
+
+    xSemaphoreTake(_mtx, portMAX_DELAY);
+    _stages[idx] = stage;
+    _save();
+    xSemaphoreGive(_mtx);
+    return true;
+}
+
+//==================== Wake ramp ====================
+
+// Sets how many minutes before each alarm playback starts. Takes effect from the next occurrence
+// (the settings change hook reprograms the hardware alarms).
+void AlarmSystem::setWakeRamp(uint8_t minutes, bool syncBacklight)
+{
+    SETTINGS.set(Setting::WakeRampMin, std::min(minutes, MAX_WAKE_RAMP_MIN));
+    SETTINGS.set(Setting::WakeRampSync, syncBacklight);
+}
+
+uint8_t AlarmSystem::getWakeRamp(bool &syncBacklight)
+{
+    syncBacklight = SETTINGS.getBool(Setting::WakeRampSync);
+    return SETTINGS.get(Setting::WakeRampMin);
+}
+
+// Finds the next upcoming alarm with a binary search over the weekly schedule
+bool AlarmSystem::getNextAlarm(AlarmTime &out, DateTime &when)
+{
+    DateTime now = _tk.time();
+
+    xSemaphoreTake(_mtx, portMAX_DELAY);
+    int idx = _nextEntry(minuteOfWeek(now));
+    if (idx >= 0)
+    {
+        out = _alarms[_schedule[idx].alarm];
+        when = nextOccurrence(_schedule[idx].minuteOfWeek, now);
+    }
+    xSemaphoreGive(_mtx);
+
+    return idx >= 0;
+}
+
+//==================== Ringing ====================
+
+void AlarmSystem::dismissAlarm()
+{
     _ringing = false;
 
+    // Playback and escalation timers are stopped by the alarm task
+    if (_task)
+        xTaskNotify(_task, NOTIFY_DISMISS, eSetBits);
+
     // Event callback
     if (_onAlarmEvent)
         _onAlarmEvent();
@@ -87,19 +472,281 @@ bool AlarmSystem::isRinging()
     return _ringing;
 }
 
-// Check if DS3231 hardware alarm fired and trigger if needed
-bool AlarmSystem::isAlarmTime()
+//==================== Private helpers ====================
+
+// Reads and services DS3231 alarm flags. Returns whether ringing should start, and how long
+// the wake ramp has left until the alarm time. Runs on the alarm task.
+bool AlarmSystem::_checkFired(uint32_t &wakeMs)
 {
-    if (!_alarm.enabled)
+    // Alarm 1 always holds the nearest occurrence, so an empty slot means nothing is scheduled
+    if (_slotMinute[0] == NO_SLOT)
         return false;
 
-    if (_rtc.alarmFired(1) && !_ringing)
+    xSemaphoreTake(_mtx, portMAX_DELAY);
+    bool fired = false;
+    bool ring = false;
+    uint8_t ringStage = 0;
+    uint16_t ringMinute = NO_SLOT;
+    for (uint8_t slot = 1; slot <= 2; slot++)
+    {
+        uint8_t stage;
+        if (_slotMinute[slot - 1] == NO_SLOT || !_rtc.alarmFired(slot))
+            continue;
+
+        fired = true;
+        _consumedMinute = _slotMinute[slot - 1];
+        if (_handleFired(slot, stage) && !ring)
+        {
+            ring = true;
+            ringStage = stage;
+            ringMinute = _slotMinute[slot - 1];
+        }
+    }
+
+    // Time left until the alarm itself (the hardware fired early by up to the ramp window)
+    wakeMs = 0;
+    if (ring)
+    {
+        // INT fires at hh:mm:00, a read a moment before that still counts as that minute
+        DateTime now = _rtc.now();
+        DateTime minute(now.unixtime() + 30 - (now.unixtime() + 30) % 60);
+        uint16_t lead = (ringMinute + MINUTES_PER_WEEK - minuteOfWeek(minute)) % MINUTES_PER_WEEK;
+        if (lead > 0 && lead <= SETTINGS.get(Setting::WakeRampMin))
+            wakeMs = (lead * 60L + (minute - now).totalseconds()) * 1000L;
+    }
+
+    // Slide the two hardware alarms forward to the next occurrences (also releases the INT pin)
+    if (fired)
+        _programRTC();
+
+    bool start = ring && !_ringing;
+    if (start)
     {
         _ringing = true;
-        return true;
+        _ringStage = ringStage;
+    }
+    xSemaphoreGive(_mtx);
+
+    // Ringing, or a skipped/one-shot occurrence changing the upcoming alarm
+    if (fired)
+        _eventPending = true;
+    if (start && wakeMs > 0 && SETTINGS.getBool(Setting::WakeRampSync))
+        _wakeRampPendingMs = wakeMs;
+
+    return start;
+}
+
+// Compiles enabled alarms into a sorted list of weekly occurrences. Only runs on table changes.
+void AlarmSystem::_rebuildSchedule()
+{
+    _scheduleSize = 0;
+    for (uint8_t i = 0; i < _alarmCount; i++)
+    {
+        const AlarmTime &a = _alarms[i];
+        if (!a.enabled)
+            continue;
+
+        uint16_t minuteOfDay = a.hour * 60 + a.minute;
+        for (uint8_t d = 0; d < 7; d++)
+        {
+            // One-shots are listed on every day so they match the next time of day
+            if (a.days == ONE_SHOT || (a.days & (1 << d)))
+                _schedule[_scheduleSize++] = {uint16_t(d * MINUTES_PER_DAY + minuteOfDay), i};
+        }
     }
 
-    return false;
+    std::sort(_schedule, _schedule + _scheduleSize,
+              [](const ScheduleEntry &a, const ScheduleEntry &b)
+              { return a.minuteOfWeek < b.minuteOfWeek; });
+}
+
+// Returns index of the first schedule entry strictly after the given minute (wrapping), or -1
+int AlarmSystem::_nextEntry(uint16_t minute) const
+{
+    if (_scheduleSize == 0)
+        return -1;
+
+    const ScheduleEntry *end = _schedule + _scheduleSize;
+    const ScheduleEntry *it = std::upper_bound(_schedule, end, minute,
+                                               [](uint16_t m, const ScheduleEntry &e)
+                                               { return m < e.minuteOfWeek; });
+    return it == end ? 0 : int(it - _schedule);
+}
+
+// Programs the two nearest distinct occurrences into DS3231 alarm 1 and alarm 2,
+// each set to fire at the start of its wake ramp
+void AlarmSystem::_programRTC()
+{
+    // Straight from the RTC: the loop's cached time can still be in the previous minute, and
+    // arming the minute that already started would miss it for a week
+    DateTime now = _rtc.now();
+    uint16_t from = minuteOfWeek(now);
+    uint8_t rampMin = SETTINGS.get(Setting::WakeRampMin);
+
+    // An occurrence already ringing through its wake ramp is still ahead of now, don't arm it again
+    if (_consumedMinute != NO_SLOT &&
+        (_consumedMinute + MINUTES_PER_WEEK - from) % MINUTES_PER_WEEK <= rampMin)
+        from = _consumedMinute;
+    int idx = _nextEntry(from);
+
+    for (uint8_t slot = 0; slot < 2; slot++)
+    {
+        _rtc.clearAlarm(slot + 1);
+
+        if (idx < 0)
+        {
+            _slotMinute[slot] = NO_SLOT;
+            _rtc.disableAlarm(slot + 1);
+            continue;
+        }
+
+        uint16_t target = _schedule[idx].minuteOfWeek;
+        _slotMinute[slot] = target;
+
+        // Fire early by the ramp window, but never in the past when the alarm is closer than that
+        DateTime when = nextOccurrence(target, now);
+        uint32_t untilMin = (when - now).totalseconds() / 60;
+        uint8_t lead = std::min<uint32_t>(rampMin, untilMin > 0 ? untilMin - 1 : 0);
+        when = when - TimeSpan((int32_t)lead * 60);
+
+        // Day-of-week matching keeps the alarm valid across date adjustments
+        if (slot == 0)
+            _rtc.setAlarm1(when, DS3231_A1_Day);
+        else
+            _rtc.setAlarm2(when, DS3231_A2_Day);
+
+        // Alarms sharing a minute are handled together, so skip to the next distinct minute
+        int start = idx;
+        do
+            idx = (idx + 1) % _scheduleSize;
+        while (idx != start && _schedule[idx].minuteOfWeek == target);
+        if (idx == start)
+            idx = -1;
+    }
+}
+
+// Consumes one fired hardware slot. Returns whether any alarm due at that minute should ring,
+// and the escalation stage of the first one that does.
+bool AlarmSystem::_handleFired(uint8_t slot, uint8_t &stage)
+{
+    uint16_t minute = _slotMinute[slot - 1];
+
+    // Alarms due at this minute are contiguous in the sorted schedule
+    const ScheduleEntry *begin = _schedule;
+    const ScheduleEntry *end = begin + _scheduleSize;
+    const ScheduleEntry *it = std::lower_bound(begin, end, minute,
+                                               [](const ScheduleEntry &e, uint16_t m)
+                                               { return e.minuteOfWeek < m; });
+
+    uint8_t due[MAX_ALARMS];
+    uint8_t dueCount = 0;
+    for (; it != end && it->minuteOfWeek == minute; ++it)
+        due[dueCount++] = it->alarm;
+
+    bool ring = false;
+    bool changed = false;
+    for (uint8_t i = 0; i < dueCount; i++)
+    {
+        AlarmTime &a = _alarms[due[i]];
+        if (a.skipNext)
+        {
+            a.skipNext = false;
+            changed = true;
+        }
+        else if (!ring)
+        {
+            ring = true;
+            stage = a.stage;
+        }
+
+        if (a.days == ONE_SHOT)
+        {
+            a.enabled = false;
+            changed = true;
+        }
+    }
+
+    if (changed)
+    {
+        _rebuildSchedule();
+        _save();
+    }
+    return ring;
+}
+
+// Applies a table change: recompiles schedule, reprograms hardware alarms and saves. Mutex must be held.
+void AlarmSystem::_commit()
+{
+    _rebuildSchedule();
+    _programRTC();
+    _save();
+}
+
+// Saves alarm table and escalation stages to flash
+void AlarmSystem::_save()
+{
+    _prefs.begin("alarms", false);
+    _prefs.putBytes("escalation", _stages, sizeof(_stages));
+    _prefs.putUChar("version", TABLE_VERSION);
+    _prefs.putUChar("count", _alarmCount);
+    if (_alarmCount > 0)
+        _prefs.putBytes("table", _alarms, sizeof(AlarmTime) * _alarmCount);
+    else
+        _prefs.remove("table");
+    _prefs.end();
+}
+
+// Loads alarm table and escalation stages from flash, returns false if no valid table was saved.
+// Tables saved before the version key have the version 1 layout and are migrated.
+bool AlarmSystem::_load(bool &migrated)
+{
+    _prefs.begin("alarms", true);
+    if (_prefs.getBytesLength("escalation") == sizeof(_stages))
+        _prefs.getBytes("escalation", _stages, sizeof(_stages));
+
+    bool saved = _prefs.isKey("count");
+    bool ok = saved;
+    uint8_t version = _prefs.getUChar("version", 1);
+    if (ok)
+    {
+        _alarmCount = std::min(_prefs.getUChar("count", 0), MAX_ALARMS);
+        if (_alarmCount > 0 && version == TABLE_VERSION)
+            ok = _prefs.getBytes("table", _alarms, sizeof(_alarms)) == sizeof(AlarmTime) * _alarmCount;
+        else if (_alarmCount > 0 && version == 1)
+            ok = _loadV1();
+        else if (_alarmCount > 0)
+            ok = false;
+    }
+    _prefs.end();
+
+    if (!ok)
+        _alarmCount = 0;
+    if (saved && !ok)
+        LOG.log("Warning! Saved alarms (table version %d) could not be read, alarms were reset.", version);
+    migrated = ok && version != TABLE_VERSION;
+    if (migrated)
+        LOG.log("Saved alarms migrated from table version %d.", version);
+    return ok;
+}
+
+// Version 1 entries lack the escalation stage, they start at stage 0
+bool AlarmSystem::_loadV1()
+{
+    struct AlarmTimeV1
+    {
+        uint8_t hour;
+        uint8_t minute;
+        bool enabled;
+        uint8_t days;
+        bool skipNext;
+    };
+
+    AlarmTimeV1 old[MAX_ALARMS];
+    if (_prefs.getBytes("table", old, sizeof(old)) != sizeof(AlarmTimeV1) * _alarmCount)
+        return false;
+    for (uint8_t i = 0; i < _alarmCount; i++)
+        _alarms[i] = {old[i].hour, old[i].minute, old[i].enabled, old[i].days, old[i].skipNext, 0};
+    return true;
 }
 
 // Read DS3231 alarm register to determine whether hardware alarm is enabled
@@ -112,15 +759,3 @@ bool AlarmSystem::_isRTCAlarmEnabled()
     uint8_t ctrl = Wire.available() ? Wire.read() : 0;
     return ctrl & 0x01; // Bit 0: Alarm 1 enabled
 }
-
-// Using _alarmMillis, checks if 5 minutes has passed since last synced with millis().
-bool AlarmSystem::_fiveMinutesPassed()
-{
-    const unsigned long FIVE_MINUTES = 5UL * 60UL * 1000UL;
-    if (millis() - _alarmMillis >= FIVE_MINUTES)
-    {
-        _alarmMillis = millis(); // reset for next interval
-        return true;
-    }
-    return false;
-}
\ No newline at end of file
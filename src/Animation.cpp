@@ -0,0 +1,249 @@
+#include "Animation.h"
+
+using namespace AnimationConfig;
+
+float ease(Ease curve, float t)
+{
+    if (t <= 0.0f)
+        return 0.0f;
+    if (t >= 1.0f)
+        return 1.0f;
+
+    switch (curve)
+    {
+    case Ease::In:
+        return t * t;
+    case Ease::Out:
+        return t * (2.0f - t);
+    case Ease::InOut:
+        return t * t * (3.0f - 2.0f * t);
+    default:
+        return t;
+    }
+}
+
+//==================== Animation ====================
+
+Animation Animation::flash(uint16_t id, const Region &area, uint16_t color, uint32_t ms)
+{
+    Animation a = {};
+    a.effect = Effect::Flash;
+    a.id = id;
+    a.duration = ms;
+    a.area = area;
+    a.color = color;
+    return a;
+}
+
+Animation Animation::fade(uint16_t id, const Region &area, uint16_t from, uint16_t to, uint32_t ms, Ease curve)
+{
+    Animation a = flash(id, area, from, ms);
+    a.effect = Effect::Fade;
+    a.curve = curve;
+    a.toColor = to;
+    return a;
+}
+
+Animation Animation::slide(uint16_t id, Widget *widget, int16_t dx, int16_t dy, uint32_t ms, Ease curve)
+{
+    Animation a = {};
+    a.effect = Effect::Slide;
+    a.curve = curve;
+    a.id = id;
+    a.duration = ms;
+    a.widget = widget;
+    a.dx = dx;
+    a.dy = dy;
+    return a;
+}
+
+Animation Animation::blink(uint16_t id, Widget *widget, uint16_t period, uint32_t ms)
+{
+    Animation a = {};
+    a.effect = Effect::Blink;
+    a.id = id;
+    a.duration = ms;
+    a.widget = widget;
+    a.period = period ? period : 1;
+    return a;
+}
+
+//==================== Animator ====================
+
+// Constructor
+Animator::Animator()
+    : _slots(), _damage(), _damageCount(0)
+{
+}
+
+bool Animator::start(const Animation &anim, uint32_t now)
+{
+    if (anim.id)
+        cancel(anim.id);
+
+    for (Slot &slot : _slots)
+    {
+        if (slot.used)
+            continue;
+        slot.used = true;
+        slot.anim = anim;
+        slot.start = now;
+        slot.shown = anim.color;
+        if (_isOverlay(anim))
+            _addDamage(anim.area);
+        return true;
+    }
+    return false;
+}
+
+void Animator::cancel(uint16_t id)
+{
+    for (Slot &slot : _slots)
+        if (slot.used && slot.anim.id == id)
+            _finish(slot);
+}
+
+void Animator::cancelAll()
+{
+    for (Slot &slot : _slots)
+        if (slot.used)
+            _finish(slot);
+}
+
+bool Animator::isRunning(uint16_t id) const
+{
+    for (const Slot &slot : _slots)
+        if (slot.used && slot.anim.id == id)
+            return true;
+    return false;
+}
+
+bool Animator::active() const
+{
+    for (const Slot &slot : _slots)
+        if (slot.used)
+            return true;
+    return false;
+}
+
+void Animator::step(uint32_t now)
+{
+    for (Slot &slot : _slots)
+    {
+        if (!slot.used)
+            continue;
+
+        const Animation &a = slot.anim;
+        uint32_t elapsed = now - slot.start;
+        if (a.duration && elapsed >= a.duration)
+        {
+            _finish(slot);
+            continue;
+        }
+        float t = a.duration ? ease(a.curve, (float)elapsed / a.duration) : 0.0f;
+
+        switch (a.effect)
+        {
+        case Effect::Flash:
+            break;
+        case Effect::Fade:
+        {
+            uint16_t color = _blend(a.color, a.toColor, t);
+            if (color != slot.shown)
+            {
+                slot.shown = color;
+                _addDamage(a.area);
+            }
+            break;
+        }
+        case Effect::Slide:
+            a.widget->setOffset(a.dx * (1.0f - t), a.dy * (1.0f - t));
+            break;
+        case Effect::Blink:
+            a.widget->setVisible((elapsed / a.period) % 2 == 0);
+            break;
+        }
+    }
+}
+
+uint8_t Animator::damage(Region *out, uint8_t max) const
+{
+    uint8_t n = _damageCount < max ? _damageCount : max;
+    memcpy(out, _damage, n * sizeof(Region));
+    return n;
+}
+
+void Animator::clean()
+{
+    _damageCount = 0;
+}
+
+void Animator::invalidate()
+{
+    for (const Slot &slot : _slots)
+        if (slot.used && _isOverlay(slot.anim))
+            _addDamage(slot.anim.area);
+}
+
+bool Animator::covers(const Region &area, uint16_t &color) const
+{
+    // Later slots draw on top, the topmost overlay touching the area decides
+    for (int8_t i = MAX_ANIMATIONS - 1; i >= 0; i--)
+    {
+        const Slot &slot = _slots[i];
+        if (!slot.used || !_isOverlay(slot.anim) || !slot.anim.area.intersects(area))
+            continue;
+        color = slot.shown;
+        return slot.anim.area.contains(area);
+    }
+    return false;
+}
+
+void Animator::draw(TFT_eSPI &gfx, int16_t dx, int16_t dy, const Region &area) const
+{
+    for (const Slot &slot : _slots)
+    {
+        if (!slot.used || !_isOverlay(slot.anim) || !slot.anim.area.intersects(area))
+            continue;
+        Region r = slot.anim.area.clipTo(area);
+        gfx.fillRect(r.x + dx, r.y + dy, r.w, r.h, slot.shown);
+    }
+}
+
+//==================== Private helpers ====================
+
+// Puts back what the animation changed
+void Animator::_finish(Slot &slot)
+{
+    const Animation &a = slot.anim;
+    if (_isOverlay(a))
+        _addDamage(a.area);
+    else if (a.effect == Effect::Slide)
+        a.widget->setOffset(0, 0);
+    else
+        a.widget->setVisible(true);
+    slot.used = false;
+}
+
+// A full list grows its last area instead of losing damage
+void Animator::_addDamage(const Region &area)
+{
+    if (_damageCount < MAX_DAMAGE)
+        _damage[_damageCount++] = area;
+    else
+        _damage[MAX_DAMAGE - 1] = _damage[MAX_DAMAGE - 1].merge(area);
+}
+
+bool Animator::_isOverlay(const Animation &anim)
+{
+    return anim.effect == Effect::Flash || anim.effect == Effect::Fade;
+}
+
+// RGB565 per channel
+uint16_t Animator::_blend(uint16_t from, uint16_t to, float t)
+{
+    uint8_t r = ((from >> 11) & 0x1F) + (((to >> 11) & 0x1F) - ((from >> 11) & 0x1F)) * t;
+    uint8_t g = ((from >> 5) & 0x3F) + (((to >> 5) & 0x3F) - ((from >> 5) & 0x3F)) * t;
+    uint8_t b = (from & 0x1F) + ((to & 0x1F) - (from & 0x1F)) * t;
+    return (r << 11) | (g << 5) | b;
+}
@@ -1,7 +1,10 @@
 #include "AppController.h"
+#include "Log.h"
 
-AppController::AppController(Buttons &btn, RFIDHandler &rfid, AlarmSystem &alm, UI &ui, DFRobotDFPlayerMini &player)
-    : _btn(btn), _rfid(rfid), _alm(alm), _ui(ui), _player(player), _lastPressedMillis(0)
+AppController::AppController(Buttons &btn, Gestures &gestures, RFIDHandler &rfid, AlarmSystem &alm, UI &ui, DisplayPower &power,
+                             BrightnessController &bright, AudioPlayer &player, TrackCatalog &tracks, CardRegistry &cards)
+    : _btn(btn), _gestures(gestures), _rfid(rfid), _alm(alm), _ui(ui), _power(power), _bright(bright),
+      _player(player), _tracks(tracks), _cards(cards), _swallowMask(0), _bindingState(State::Boot)
 {
 }
 
@@ -12,10 +15,49 @@ void AppController::handleIn()
     // handleRFIDIn(); //TODO: add usage for this
 }
 
-// State machine that handles button input depending on UI state
+// Feeds button events to the gesture recognizer and dispatches recognized gestures
 void AppController::handleButtonIn()
 {
-    ButtonState s = _btn.getState();
+    // Only buttons with a double click binding wait out the double click window
+    State state = _ui.getState();
+    if (state != _bindingState)
+    {
+        size_t count;
+        const GestureBinding *table = bindingsFor(state, count);
+        uint8_t mask = 0;
+        for (size_t i = 0; i < count; i++)
+            if (table[i].type == GestureType::DoubleClick)
+                mask |= table[i].buttons;
+        _gestures.setDoubleClickMask(mask);
+        _bindingState = state;
+    }
+
+    ButtonEvent ev;
+    while (_btn.nextEvent(ev))
+    {
+        uint8_t bit = 1 << ev.button;
+
+        // Any press wakes the display, a press on a dark display only wakes it
+        if (ev.down && _power.wake())
+        {
+            _swallowMask |= bit;
+            continue;
+        }
+        if (!ev.down && (_swallowMask & bit))
+        {
+            _swallowMask &= ~bit;
+            continue;
+        }
+        _gestures.feed(ev);
+    }
+
+    Gesture g;
+    while (_gestures.next(g))
+        dispatchGesture(g);
+}
+
+void AppController::handleRFIDIn()
+{
     switch (_ui.getState())
     {
     case State::Boot:
@@ -25,42 +67,8 @@ void AppController::handleButtonIn()
     }
     case State::Clock:
     {
-        if (s.singlePressed() && !_alm.isRinging()) // Alarm disables button controls (for now)
-        {
-            if (s.btn1.pressed) // Decrement by 30 minutes
-            {
-                AlarmTime a = _alm.getAlarm();
-
-                int totalMinutes = a.hour * 60 + a.minute - 30;
-                if (totalMinutes < 0)
-                    totalMinutes += 24 * 60;
-
-                _alm.setAlarm((totalMinutes / 60) % 24, totalMinutes % 60, true);
-            }
-            if (s.btn2.pressed) // Increment by 30 minutes
-            {
-                AlarmTime a = _alm.getAlarm();
-
-                int totalMinutes = a.hour * 60 + a.minute + 30;
-                totalMinutes %= (24 * 60);
-
-                _alm.setAlarm((totalMinutes / 60) % 24, totalMinutes % 60, true);
-            }
-            if (s.btn3.pressed) // Plays random track
-            {
-                if (millis() - _lastPressedMillis <= 500)
-                    _player.stop();
-                else
-                    _player.play(random(1, Tracks::totalTrackCount + 1));
-                _lastPressedMillis = millis();
-            }
-            if (s.btn4.pressed) // Toggles alarm
-            {
-                AlarmTime a = _alm.getAlarm();
-                _alm.setAlarm(a.hour, a.minute, !a.enabled);
-            }
-            break;
-        }
+        /* code */
+        break;
     }
     case State::Settings: // Settings not set up
     {
@@ -72,26 +80,145 @@ void AppController::handleButtonIn()
     }
 }
 
-void AppController::handleRFIDIn()
+void AppController::handleCardIn(const uint8_t *uid, uint8_t len)
 {
-    switch (_ui.getState())
+    _power.wake();
+
+    if (_cards.isEnrolling())
     {
-    case State::Boot:
+        char hex[CardConfig::UID_STR_LEN];
+        CardRegistry::formatUID(uid, len, hex);
+        if (_cards.completeEnroll(uid, len))
+        {
+            LOG.log("Card %s enrolled.", hex);
+            _ui.flashScreen(TFT_GREEN);
+        }
+        else
+        {
+            LOG.log("Card %s not enrolled, registry full.", hex);
+            _ui.flashScreen(TFT_RED);
+        }
+        return;
+    }
+
+    Card card;
+    if (!_cards.match(uid, len, card))
     {
-        /* code */
-        break;
+        // No cards enrolled: any card dismisses, so the alarm can't become undismissable
+        if (_cards.count() == 0 && _alm.isRinging())
+        {
+            LOG.log("No cards enrolled, dismissing with unknown card.");
+            _alm.dismissAlarm();
+            _ui.flashScreen(TFT_GREEN);
+        }
+        return;
     }
-    case State::Clock:
+
+    switch (card.action)
     {
-        /* code */
+    case CardAction::Dismiss:
+        if (_alm.isRinging())
+        {
+            _alm.dismissAlarm();
+            _ui.flashScreen(TFT_GREEN);
+        }
         break;
-    }
-    case State::Settings: // Settings not set up
+    case CardAction::ToggleAlarm:
     {
-        /* code */
+        AlarmTime a = _alm.getAlarm();
+        _alm.setAlarm(a.hour, a.minute, !a.enabled);
         break;
     }
-    default:
+    case CardAction::Command:
+        if (_onCardCommand)
+            _onCardCommand(card.macro);
         break;
     }
-}
\ No newline at end of file
+}
+
+void AppController::onCardCommand(CardCommandCallback cb)
+{
+    _onCardCommand = cb;
+}
+
+//==================== Gesture actions ====================
+
+void AppController::alarmEarlier(const Gesture &g) { shiftAlarm(-30); }
+void AppController::alarmLater(const Gesture &g) { shiftAlarm(30); }
+void AppController::alarmEarlierFine(const Gesture &g) { shiftAlarm(-5); }
+void AppController::alarmLaterFine(const Gesture &g) { shiftAlarm(5); }
+
+// Plays random track
+void AppController::playTrack(const Gesture &g)
+{
+    _tracks.play(TrackConfig::ALL);
+}
+
+void AppController::stopTrack(const Gesture &g)
+{
+    _player.stop();
+}
+
+// Toggles alarm
+void AppController::toggleAlarm(const Gesture &g)
+{
+    AlarmTime a = _alm.getAlarm();
+    _alm.setAlarm(a.hour, a.minute, !a.enabled);
+}
+
+// Manual backlight correction, teaches the ambient curve
+void AppController::brightnessDown(const Gesture &g)
+{
+    _bright.nudge(-BrightnessConfig::NUDGE_STEP);
+}
+
+void AppController::brightnessUp(const Gesture &g)
+{
+    _bright.nudge(BrightnessConfig::NUDGE_STEP);
+}
+
+//==================== Helpers ====================
+
+// Binding table of a UI state, NULL if the state takes no button input
+const AppController::GestureBinding *AppController::bindingsFor(State state, size_t &count) const
+{
+    switch (state)
+    {
+    case State::Clock:
+        count = NUM_CLOCK_BINDINGS;
+        return _clockBindings;
+    case State::Settings: // Settings not set up
+    default:
+        count = 0;
+        return NULL;
+    }
+}
+
+// Runs the action bound to a gesture in the current UI state
+void AppController::dispatchGesture(const Gesture &g)
+{
+    if (_alm.isRinging()) // Alarm disables button controls (for now)
+        return;
+
+    size_t count;
+    const GestureBinding *table = bindingsFor(_ui.getState(), count);
+    for (size_t i = 0; i < count; i++)
+    {
+        if (table[i].type == g.type && table[i].buttons == g.buttons)
+        {
+            (this->*table[i].action)(g);
+            return;
+        }
+    }
+}
+
+// Moves the alarm by a number of minutes (wrapping around midnight) and enables it
+void AppController::shiftAlarm(int minutes)
+{
+    AlarmTime a = _alm.getAlarm();
+
+    int totalMinutes = a.hour * 60 + a.minute + minutes;
+    totalMinutes = (totalMinutes % (24 * 60) + 24 * 60) % (24 * 60);
+
+    _alm.setAlarm(totalMinutes / 60, totalMinutes % 60, true);
+}
@@ -0,0 +1,237 @@
+#include "AudioPlayer.h"
+
+using namespace AudioConfig;
+
+// Constructor
+AudioPlayer::AudioPlayer(DFRobotDFPlayerMini &player)
+    : _player(player), _online(false), _queue(NULL), _task(NULL), _queryMtx(NULL),
+      _queryDone(NULL), _queryResult(-1), _volume(-1),
+      _lastFinished(0), _lastFinishedMillis(0), _stats{0, 0, 0, 0, 0, 0}
+{
+}
+
+// Inits DFPlayer and starts the audio task. The task runs even if the player
+// did not respond, so callers can always enqueue.
+bool AudioPlayer::begin(Stream &serial)
+{
+    _online = _player.begin(serial);
+    _player.setTimeOut(UART_TIMEOUT_MS);
+
+    _queue = xQueueCreate(QUEUE_LENGTH, sizeof(Command));
+    _queryMtx = xSemaphoreCreateMutex();
+    _queryDone = xSemaphoreCreateBinary();
+    if (!_queue || !_queryMtx || !_queryDone)
+    {
+        Serial.println("Warning: AudioPlayer queue initialization failed.");
+        return false;
+    }
+
+    // Core 0, so ack waits in the DFPlayer library never stall loop()
+    xTaskCreatePinnedToCore(_taskEntry, "AudioTask", 4096, this, 1, &_task, 0);
+
+    return _online;
+}
+
+bool AudioPlayer::volume(uint8_t vol)
+{
+    return _enqueue({Op::Volume, vol, 0});
+}
+
+bool AudioPlayer::play(uint16_t track)
+{
+    return _enqueue({Op::Play, 0, track});
+}
+
+bool AudioPlayer::playFolder(uint8_t folder, uint8_t track)
+{
+    return _enqueue({Op::PlayFolder, folder, track});
+}
+
+// Stop supersedes anything still pending, so it can never be dropped
+bool AudioPlayer::stop()
+{
+    if (_queue)
+        xQueueReset(_queue);
+    return _enqueue({Op::Stop, 0, 0});
+}
+
+// Sends a query through the audio task and waits for its answer
+int AudioPlayer::query(Query q, uint8_t folder, uint32_t timeoutMs)
+{
+    if (!_queryMtx)
+        return -1;
+
+    xSemaphoreTake(_queryMtx, portMAX_DELAY);
+    xSemaphoreTake(_queryDone, 0); // Drop a late answer to a timed out query
+
+    int result = -1;
+    if (_enqueue({Op::Query, folder, (uint16_t)q}) && xSemaphoreTake(_queryDone, pdMS_TO_TICKS(timeoutMs)) == pdTRUE)
+        result = _queryResult;
+
+    xSemaphoreGive(_queryMtx);
+    return result;
+}
+
+bool AudioPlayer::queryAsync(Query q, uint8_t folder)
+{
+    return _enqueue({Op::QueryAsync, folder, (uint16_t)q});
+}
+
+// Returns a snapshot of UART statistics (fields are updated by the audio task only)
+AudioPlayer::Stats AudioPlayer::getStats() const
+{
+    return _stats;
+}
+
+bool AudioPlayer::isOnline() const
+{
+    return _online;
+}
+
+//==================== Audio task ====================
+
+// Drains the command queue and reads player messages between commands
+void AudioPlayer::_taskEntry(void *arg)
+{
+    AudioPlayer *self = static_cast<AudioPlayer *>(arg);
+
+    while (true)
+    {
+        Command cmd;
+        if (xQueueReceive(self->_queue, &cmd, pdMS_TO_TICKS(EVENT_POLL_MS)) == pdTRUE)
+        {
+            // Collapse a run of volume changes into the last one
+            Command next;
+            while (cmd.op == Op::Volume && xQueuePeek(self->_queue, &next, 0) == pdTRUE && next.op == Op::Volume)
+            {
+                xQueueReceive(self->_queue, &cmd, 0);
+                self->_stats.coalesced++;
+            }
+
+            self->_execute(cmd);
+        }
+
+        self->_handleMessages();
+    }
+}
+
+// Performs one command over the UART. Blocks (on the audio task only) for the previous ack.
+void AudioPlayer::_execute(const Command &cmd)
+{
+    switch (cmd.op)
+    {
+    case Op::Volume:
+        if (cmd.arg == _volume)
+        {
+            _stats.coalesced++;
+            return;
+        }
+        _player.volume(cmd.arg);
+        _volume = cmd.arg;
+        break;
+
+    case Op::Play:
+        _player.play(cmd.track);
+        break;
+
+    case Op::PlayFolder:
+        _player.playFolder(cmd.arg, cmd.track);
+        break;
+
+    case Op::Stop:
+        _player.stop();
+        break;
+
+    case Op::Query:
+        _queryResult = _read((Query)cmd.track, cmd.arg);
+        xSemaphoreGive(_queryDone);
+        break;
+
+    case Op::QueryAsync:
+    {
+        int result = _read((Query)cmd.track, cmd.arg);
+        if (_onQueryAnswer)
+            _onQueryAnswer((Query)cmd.track, cmd.arg, result);
+        break;
+    }
+    }
+    _stats.sent++;
+}
+
+// Waits (up to UART_TIMEOUT_MS) for the player's answer, -1 if none
+int AudioPlayer::_read(Query q, uint8_t folder)
+{
+    switch (q)
+    {
+    case Query::FileCount:
+        return _player.readFileCounts();
+    case Query::FolderCount:
+        return _player.readFolderCounts();
+    case Query::FolderFileCount:
+        return _player.readFileCountsInFolder(folder);
+    }
+    return -1;
+}
+
+// Reads pending player messages: acks, errors and track finished reports
+void AudioPlayer::_handleMessages()
+{
+    while (_player.available())
+    {
+        uint8_t type = _player.readType();
+        uint16_t value = _player.read();
+
+        switch (type)
+        {
+        case DFPlayerPlayFinished:
+        {
+            // Finished is reported twice per track
+            unsigned long now = millis();
+            if (value == _lastFinished && now - _lastFinishedMillis < FINISH_DEDUPE_MS)
+                break;
+            _lastFinished = value;
+            _lastFinishedMillis = now;
+
+            _stats.finished++;
+            if (_onTrackFinished)
+                _onTrackFinished(value);
+            break;
+        }
+
+        case DFPlayerError:
+            _stats.errors++;
+            _stats.lastError = (uint8_t)value;
+            break;
+
+        case TimeOut:
+        case WrongStack:
+            _stats.errors++;
+            _stats.lastError = 0;
+            _volume = -1; // Player state unknown, resend next volume
+            break;
+
+        case DFPlayerCardOnline:
+        case DFPlayerCardInserted:
+            _online = true;
+            break;
+
+        case DFPlayerCardRemoved:
+            _online = false;
+            break;
+
+        default:
+            break;
+        }
+    }
+}
+
+// Posts a command without blocking
+bool AudioPlayer::_enqueue(const Command &cmd)
+{
+    if (!_queue || xQueueSend(_queue, &cmd, 0) != pdTRUE)
+    {
+        _stats.dropped++;
+        return false;
+    }
+    return true;
+}
@@ -1,4 +1,7 @@
 #include "BrightnessController.h"
+#include "Settings.h"
+#include <algorithm>
+#include <math.h>
 
 using namespace BrightnessConfig;
 // Constructor
@@ -10,104 +13,434 @@ BrightnessController::BrightnessController(uint8_t pwmPin,
     : _pwmPin(pwmPin), _pwmChannel(pwmChannel),
       _pwmFreq(pwmFreq), _pwmRes(pwmRes),
       _photoresistorPin(photoresistorPin),
+      // Arduino LEDC channels 0-7 are the high speed group, 8-15 low speed
+      _ledcMode((ledc_mode_t)(pwmChannel / 8)),
+      _ledcChannel((ledc_channel_t)(pwmChannel % 8)),
       _currentBrightness(BRIGHTNESS_MAX),
       _targetBrightness(BRIGHTNESS_MAX),
-      _lastLightReading(0),
-      _lastFadeUpdate(0),
-      _lastAmbientUpdate(0)
+      _fading(false),
+      _ramping(false),
+      _limit(BRIGHTNESS_MAX),
+      _request(0),
+      _fadeFrom(0), _fadeTo(0), _segment(0), _segmentCount(0), _segmentMs(0), _segmentDuty(0),
+      _adcChannel((adc1_channel_t)digitalPinToAnalogChannel(photoresistorPin)),
+      _adcChars(),
+      _lightMv(-1.0f),
+      _lux(0.0f),
+      _correctionHead(0), _correctionCount(0),
+      _mtx(NULL)
 {
+    memcpy(_knots, DEFAULT_KNOTS, sizeof(_knots));
+    _rebuildLut();
 }
 
 void BrightnessController::begin()
 {
+    _mtx = xSemaphoreCreateMutex();
+    if (!_mtx)
+        Serial.println("Warning: Brightness mutex initialization failed.");
+    _loadCurve();
+
     ledcSetup(_pwmChannel, _pwmFreq, _pwmRes);
     ledcAttachPin(_pwmPin, _pwmChannel);
-    pinMode(_photoresistorPin, INPUT);
 
-    setBrightness(BRIGHTNESS_MAX);
-    _lastLightReading = readLightSensor();
+    // Calibrated ADC1 readings (eFuse Vref where available)
+    adc1_config_width(ADC_WIDTH_BIT_12);
+    adc1_config_channel_atten(_adcChannel, ADC_ATTEN_DB_11);
+    esp_adc_cal_characterize(ADC_UNIT_1, ADC_ATTEN_DB_11, ADC_WIDTH_BIT_12, 1100, &_adcChars);
+
+    // Gamma table, lowest non-zero level still lights the backlight
+    uint32_t maxDuty = (1UL << _pwmRes) - 1;
+    _gamma[0] = 0;
+    for (int i = 1; i < 256; i++)
+        _gamma[i] = std::max<uint32_t>(1, lroundf(powf(i / 255.0f, GAMMA) * maxDuty));
+
+    // Fade engine with an end-of-fade interrupt to chain segments
+    ledc_fade_func_install(0);
+    ledc_cbs_t cbs = {_onFadeEnd};
+    ledc_cb_register(_ledcMode, _ledcChannel, &cbs, this);
+
+    ledc_set_duty_and_update(_ledcMode, _ledcChannel, _gamma[BRIGHTNESS_MAX], 0);
+    _currentBrightness = BRIGHTNESS_MAX;
+    _targetBrightness = BRIGHTNESS_MAX;
+
+    // Sampler on core 0, away from the loop task
+    if (xTaskCreatePinnedToCore(_samplerEntry, "AmbientTask", 3072, this, 1, NULL, 0) != pdPASS)
+        Serial.println("Warning: Ambient sampler task creation failed.");
 }
 
+// Jumps straight to a level
 void BrightnessController::setBrightness(uint8_t level)
 {
     if (level < BRIGHTNESS_MIN && level > 0)
         level = BRIGHTNESS_MIN;
 
-    _currentBrightness = level;
     _targetBrightness = level;
-    ledcWrite(_pwmChannel, _currentBrightness);
+    _ramping = false;
+    _requestFade(level, 0);
 }
 
+// Fades to a level, taking FADE_TIME_MS for the full range
 void BrightnessController::setTargetBrightness(uint8_t level)
 {
     if (level < BRIGHTNESS_MIN && level > 0)
         level = BRIGHTNESS_MIN;
 
+    uint32_t ms = FADE_TIME_MS * abs((int)level - (int)_targetBrightness) / BRIGHTNESS_MAX;
     _targetBrightness = level;
+    _ramping = false;
+    _requestFade(level, std::max(ms, MIN_SEGMENT_MS));
 }
 
-void BrightnessController::updateFade()
+// Fades to level over durationMs (e.g. alongside an alarm wake ramp), holding off ambient updates
+void BrightnessController::rampTo(uint8_t level, uint32_t durationMs)
 {
-    unsigned long now = millis();
-    if (now - _lastFadeUpdate < FADE_STEP_DELAY)
-        return;
-    if (_currentBrightness == _targetBrightness)
+    if (level < BRIGHTNESS_MIN && level > 0)
+        level = BRIGHTNESS_MIN;
+
+    _targetBrightness = level;
+    _ramping = true;
+    _requestFade(level, durationMs);
+}
+
+void BrightnessController::setLimit(uint8_t limit)
+{
+    bool raise = limit > _limit;
+    _limit = limit;
+    if (_ramping)
         return;
 
-    if (_currentBrightness < _targetBrightness)
+    xSemaphoreTake(_mtx, portMAX_DELAY);
+    float mv = _lightMv;
+    uint8_t level = mv >= 0 ? calculateAmbientBrightness(mv) : _targetBrightness;
+    xSemaphoreGive(_mtx);
+    level = std::min(level, limit);
+    if (raise)
+        setBrightness(level);
+    else
+        setTargetBrightness(level);
+}
+
+uint8_t BrightnessController::getLimit() const { return _limit; }
+
+// Maps smoothed sensor voltage to a brightness level through the learned curve
+uint8_t BrightnessController::calculateAmbientBrightness(float mv) const
+{
+    return _lut[_bin(mv)];
+}
+
+uint8_t BrightnessController::getBrightness() const { return _currentBrightness; }
+uint8_t BrightnessController::getTargetBrightness() const { return _targetBrightness; }
+bool BrightnessController::isFading() const { return _fading; }
+float BrightnessController::getLightMv() const { return _lightMv; }
+float BrightnessController::getLux() const { return _lux; }
+
+//==================== Learned curve ====================
+
+// Moves brightness by delta for the current light level and records it as a correction
+bool BrightnessController::nudge(int delta)
+{
+    float mv = _lightMv;
+    if (mv < 0)
+        return false;
+
+    xSemaphoreTake(_mtx, portMAX_DELAY);
+    uint8_t bin = _bin(mv);
+    uint8_t level = constrain((int)_lut[bin] + delta, BRIGHTNESS_MIN, BRIGHTNESS_MAX);
+
+    _corrections[_correctionHead] = {bin, level};
+    _correctionHead = (_correctionHead + 1) % MAX_CORRECTIONS;
+    if (_correctionCount < MAX_CORRECTIONS)
+        _correctionCount++;
+
+    _refit(bin, level);
+    _saveCurve();
+    uint8_t target = _lut[bin];
+    xSemaphoreGive(_mtx);
+
+    setTargetBrightness(std::min(target, (uint8_t)_limit));
+    return true;
+}
+
+// Back to the factory curve, forgets all corrections
+void BrightnessController::resetCurve()
+{
+    xSemaphoreTake(_mtx, portMAX_DELAY);
+    memcpy(_knots, DEFAULT_KNOTS, sizeof(_knots));
+    _correctionHead = 0;
+    _correctionCount = 0;
+    _rebuildLut();
+    _saveCurve();
+    float mv = _lightMv;
+    uint8_t target = mv >= 0 ? calculateAmbientBrightness(mv) : 0;
+    xSemaphoreGive(_mtx);
+
+    if (mv >= 0 && !_ramping)
+        setTargetBrightness(target);
+}
+
+uint8_t BrightnessController::getKnot(uint8_t idx) const
+{
+    xSemaphoreTake(_mtx, portMAX_DELAY);
+    uint8_t knot = idx < CURVE_KNOTS ? _knots[idx] : 0;
+    xSemaphoreGive(_mtx);
+    return knot;
+}
+
+uint8_t BrightnessController::getCorrections(Correction *out, uint8_t max) const
+{
+    xSemaphoreTake(_mtx, portMAX_DELAY);
+    uint8_t n = std::min(max, _correctionCount);
+    for (uint8_t i = 0; i < n; i++)
+        out[i] = _corrections[(_correctionHead + MAX_CORRECTIONS - 1 - i) % MAX_CORRECTIONS];
+    xSemaphoreGive(_mtx);
+    return n;
+}
+
+// Table entry for a sensor voltage
+uint8_t BrightnessController::_bin(float mv)
+{
+    if (mv <= 0)
+        return 0;
+    uint32_t bin = (uint32_t)(mv * 256 / CURVE_MV_SPAN);
+    return std::min<uint32_t>(bin, 255);
+}
+
+// Incremental refit for one correction: the smallest change to the two surrounding knots
+// that puts the curve through (bin, level), then keeps the curve non-decreasing away from it
+void BrightnessController::_refit(uint8_t bin, uint8_t level)
+{
+    uint8_t k = std::min<uint8_t>(bin / KNOT_SPACING, CURVE_KNOTS - 2);
+    float w = (float)(bin - k * KNOT_SPACING) / KNOT_SPACING;
+    float err = (float)level - _lut[bin];
+    float norm = (1.0f - w) * (1.0f - w) + w * w;
+
+    int left = lroundf(_knots[k] + err * (1.0f - w) / norm);
+    int right = lroundf(_knots[k + 1] + err * w / norm);
+    _knots[k] = constrain(left, 0, BRIGHTNESS_MAX);
+    _knots[k + 1] = constrain(right, 0, BRIGHTNESS_MAX);
+    if (_knots[k + 1] < _knots[k])
+        _knots[k + 1] = _knots[k] = level;
+
+    // Brighter rooms never get a dimmer screen
+    for (int i = k - 1; i >= 0; i--)
+        _knots[i] = std::min(_knots[i], _knots[i + 1]);
+    for (int i = k + 2; i < CURVE_KNOTS; i++)
+        _knots[i] = std::max(_knots[i], _knots[i - 1]);
+
+    _rebuildLut();
+}
+
+// Expands the knots into the lookup table (linear between knots)
+void BrightnessController::_rebuildLut()
+{
+    for (uint16_t i = 0; i < 256; i++)
     {
-        uint8_t step = (uint8_t)std::min((int)FADE_STEP_SIZE, (int)(_targetBrightness - _currentBrightness));
-        _currentBrightness += step;
+        uint8_t k = std::min<uint8_t>(i / KNOT_SPACING, CURVE_KNOTS - 2);
+        int x = i - k * KNOT_SPACING;
+        int level = _knots[k] + ((int)_knots[k + 1] - (int)_knots[k]) * x / (int)KNOT_SPACING;
+        _lut[i] = std::max<int>(level, BRIGHTNESS_MIN);
     }
+}
+
+void BrightnessController::_saveCurve()
+{
+    _prefs.begin("brightness", false);
+    _prefs.putBytes("knots", _knots, sizeof(_knots));
+    // A zero length blob can't be written, an empty list removes the key instead
+    if (_correctionCount)
+        _prefs.putBytes("fixes", _corrections, _correctionCount * sizeof(Correction));
     else
+        _prefs.remove("fixes");
+    _prefs.putUChar("fixHead", _correctionHead);
+    _prefs.end();
+}
+
+void BrightnessController::_loadCurve()
+{
+    _prefs.begin("brightness", true);
+    if (_prefs.getBytesLength("knots") == sizeof(_knots))
     {
-        uint8_t step = (uint8_t)std::min((int)FADE_STEP_SIZE, (int)(_currentBrightness - _targetBrightness));
-        _currentBrightness -= step;
+        _prefs.getBytes("knots", _knots, sizeof(_knots));
+        size_t len = _prefs.getBytesLength("fixes");
+        if (len % sizeof(Correction) == 0 && len <= sizeof(_corrections))
+        {
+            _correctionCount = _prefs.getBytes("fixes", _corrections, len) / sizeof(Correction);
+            _correctionHead = _prefs.getUChar("fixHead", 0) % MAX_CORRECTIONS;
+        }
+        _rebuildLut();
     }
-
-    ledcWrite(_pwmChannel, _currentBrightness);
-    _lastFadeUpdate = now;
+    _prefs.end();
 }
 
-uint16_t BrightnessController::readLightSensor() const
+//==================== Ambient sampler ====================
+
+// Samples the light sensor every SAMPLE_PERIOD_MS and moves the backlight towards the
+// ambient target. All ADC work happens here, none in loop().
+void BrightnessController::_samplerEntry(void *arg)
 {
-    return analogRead(_photoresistorPin);
+    BrightnessController *self = static_cast<BrightnessController *>(arg);
+    TickType_t lastWake = xTaskGetTickCount();
+    uint32_t sinceTarget = TARGET_INTERVAL_MS; // Evaluate right after the first sample
+    uint32_t sinceRetarget = RETARGET_MIN_MS;
+    int8_t lastDir = 0; // Side of the threshold the previous evaluation was on
+
+    while (true)
+    {
+        self->_filter(self->_readMedianMv(), SAMPLE_PERIOD_MS);
+
+        sinceTarget += SAMPLE_PERIOD_MS;
+        sinceRetarget = std::min(sinceRetarget + SAMPLE_PERIOD_MS, RETARGET_MIN_MS);
+        if (sinceTarget >= TARGET_INTERVAL_MS && !self->_ramping)
+        {
+            sinceTarget = 0;
+            xSemaphoreTake(self->_mtx, portMAX_DELAY);
+            uint8_t newTarget = std::min(self->calculateAmbientBrightness(self->_lightMv), (uint8_t)self->_limit);
+            xSemaphoreGive(self->_mtx);
+
+            // Only a change that holds for two evaluations in a row fades, and not more often than
+            // RETARGET_MIN_MS, so sensor noise around the threshold doesn't keep queueing fades
+            int delta = (int)newTarget - (int)self->_targetBrightness;
+            int8_t dir = delta > BRIGHTNESS_CHANGE_THRESHOLD ? 1 : delta < -BRIGHTNESS_CHANGE_THRESHOLD ? -1 : 0;
+            if (dir != 0 && dir == lastDir && sinceRetarget >= RETARGET_MIN_MS)
+            {
+                self->setTargetBrightness(newTarget);
+                sinceRetarget = 0;
+                dir = 0;
+            }
+            lastDir = dir;
+        }
+
+        vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(SAMPLE_PERIOD_MS));
+    }
 }
 
-uint8_t BrightnessController::calculateAmbientBrightness()
+// Median of a short burst of calibrated reads, rejects single-sample spikes
+uint32_t BrightnessController::_readMedianMv()
 {
-    uint16_t light = readLightSensor();
+    uint32_t mv[SAMPLE_BURST];
+    for (uint8_t i = 0; i < SAMPLE_BURST; i++)
+        mv[i] = esp_adc_cal_raw_to_voltage(adc1_get_raw(_adcChannel), &_adcChars);
 
-    if (abs((int)light - (int)_lastLightReading) < LIGHT_HYSTERESIS)
-        light = _lastLightReading;
+    std::nth_element(mv, mv + SAMPLE_BURST / 2, mv + SAMPLE_BURST);
+    return mv[SAMPLE_BURST / 2];
+}
+
+// Exponential smoothing with separate rise/fall time constants, then the lux estimate
+void BrightnessController::_filter(uint32_t mv, uint32_t dtMs)
+{
+    float x = (float)mv;
+    if (_lightMv < 0)
+        _lightMv = x;
     else
-        _lastLightReading = light;
+    {
+        float tau = SETTINGS.get(x > _lightMv ? Setting::AmbientRiseMs : Setting::AmbientFallMs);
+        float alpha = 1.0f - expf(-(float)dtMs / tau);
+        _lightMv = _lightMv + alpha * (x - _lightMv);
+    }
+
+    // Divider: V = Vcc * Rd / (Rldr + Rd), and Rldr = R10 * (lux / 10)^-gamma
+    float v = std::min(std::max((float)_lightMv, 1.0f), SUPPLY_MV - 1.0f);
+    float rLdr = DIVIDER_OHMS * (SUPPLY_MV / v - 1.0f);
+    _lux = 10.0f * powf(LDR_R10_OHMS / rLdr, 1.0f / LDR_GAMMA);
+}
 
-    if (light < LIGHT_SENSOR_MIN)
-        light = LIGHT_SENSOR_MIN;
-    if (light > LIGHT_SENSOR_MAX)
-        light = LIGHT_SENSOR_MAX;
+//==================== Fade engine ====================
 
-    return map(light, LIGHT_SENSOR_MIN, LIGHT_SENSOR_MAX,
-               BRIGHTNESS_MIN, BRIGHTNESS_MAX);
+// Hands a fade to the timer service task, which owns all fade state. A newer request replaces an older one.
+void BrightnessController::_requestFade(uint8_t level, uint32_t durationMs)
+{
+    _request = ((uint32_t)level << 24) | std::min<uint32_t>(durationMs, 0xFFFFFF);
+    xTimerPendFunctionCall(_applyRequest, this, 0, 0);
 }
 
-void BrightnessController::updateAmbient()
+// Splits a fade into FADE_SEGMENTS linear hardware fades along the gamma curve
+void BrightnessController::_applyRequest(void *arg, uint32_t)
 {
-    unsigned long now = millis();
+    BrightnessController *self = static_cast<BrightnessController *>(arg);
+    uint32_t req = self->_request;
+    uint8_t level = req >> 24;
+    uint32_t ms = req & 0xFFFFFF;
+
+    // Stop a running segment first: reprogramming the channel would otherwise wait for it to
+    // end, and a wake ramp segment lasts minutes. The duty stays where it got to.
+    ledc_fade_stop(self->_ledcMode, self->_ledcChannel);
+    if (self->_fading)
+        self->_currentBrightness = self->_levelOf(ledc_get_duty(self->_ledcMode, self->_ledcChannel));
+    self->_fading = false;
+    self->_segmentDuty = UINT32_MAX;
 
-    updateFade();
+    // Start from the level the previous fade got to
+    self->_fadeFrom = self->_currentBrightness;
+    self->_fadeTo = level;
 
-    if (now - _lastAmbientUpdate < LIGHT_UPDATE_INTERVAL)
+    if (ms == 0 || self->_fadeFrom == level)
+    {
+        ledc_set_duty_and_update(self->_ledcMode, self->_ledcChannel, self->_gamma[level], 0);
+        self->_currentBrightness = level;
         return;
+    }
+
+    self->_segmentCount = std::max<uint32_t>(1, std::min<uint32_t>(FADE_SEGMENTS, ms / MIN_SEGMENT_MS));
+    self->_segmentMs = ms / self->_segmentCount;
+    self->_segment = 0;
+    self->_fading = true;
+    self->_startSegment();
+}
 
-    uint8_t newTarget = calculateAmbientBrightness();
-    if (abs((int)newTarget - (int)_targetBrightness) > BRIGHTNESS_CHANGE_THRESHOLD)
-        setTargetBrightness(newTarget);
+void BrightnessController::_startSegment()
+{
+    int span = (int)_fadeTo - (int)_fadeFrom;
+    uint8_t level = _fadeFrom + span * (_segment + 1) / _segmentCount;
 
-    _lastAmbientUpdate = now;
+    _segmentDuty = _gamma[level];
+    ledc_set_fade_with_time(_ledcMode, _ledcChannel, _segmentDuty, _segmentMs);
+    ledc_fade_start(_ledcMode, _ledcChannel, LEDC_FADE_NO_WAIT);
 }
 
-uint8_t BrightnessController::getBrightness() const { return _currentBrightness; }
-uint8_t BrightnessController::getTargetBrightness() const { return _targetBrightness; }
-bool BrightnessController::isFading() const { return _currentBrightness != _targetBrightness; }
\ No newline at end of file
+// Runs after each hardware fade ends: chains the next segment or completes the fade
+void BrightnessController::_segmentDone(void *arg, uint32_t duty)
+{
+    BrightnessController *self = static_cast<BrightnessController *>(arg);
+
+    // End of a segment that a newer request already replaced
+    if (!self->_fading || duty != self->_segmentDuty)
+        return;
+
+    self->_segment++;
+    int span = (int)self->_fadeTo - (int)self->_fadeFrom;
+    self->_currentBrightness = self->_fadeFrom + span * self->_segment / self->_segmentCount;
+
+    if (self->_segment < self->_segmentCount)
+    {
+        self->_startSegment();
+        return;
+    }
+
+    self->_fading = false;
+    self->_ramping = false;
+
+    // Fade complete callback
+    if (self->_onFadeComplete)
+        self->_onFadeComplete(self->_currentBrightness);
+}
+
+// Nearest level for a PWM duty, inverse of _gamma
+uint8_t BrightnessController::_levelOf(uint32_t duty) const
+{
+    const uint16_t *hi = std::lower_bound(_gamma, _gamma + 256, duty);
+    if (hi == _gamma + 256)
+        return BRIGHTNESS_MAX;
+    if (hi != _gamma && duty - hi[-1] < *hi - duty)
+        hi--;
+    return hi - _gamma;
+}
+
+// LEDC fade end interrupt
+bool IRAM_ATTR BrightnessController::_onFadeEnd(const ledc_cb_param_t *param, void *arg)
+{
+    BaseType_t woken = pdFALSE;
+    if (param->event == LEDC_FADE_END_EVT)
+        xTimerPendFunctionCallFromISR(_segmentDone, arg, param->duty, &woken);
+    return woken == pdTRUE;
+}
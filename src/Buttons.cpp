@@ -1,62 +1,141 @@
 // Buttons.cpp
 #include "Buttons.h"
 
+using namespace ButtonConfig;
+
 // Constructor
 Buttons::Buttons(uint8_t b1, uint8_t b2, uint8_t b3, uint8_t b4)
-    : _btn1(b1), _btn2(b2), _btn3(b3), _btn4(b4), _mtx(NULL)
+    : _pins{b1, b2, b3, b4}, _currState(0),
+      _edgeHead(0), _edgeTail(0), _overflow(false),
+      _eventHead(0), _eventTail(0)
 {
+    for (uint8_t i = 0; i < COUNT; i++)
+    {
+        _isrArgs[i] = {this, i};
+        _isrDown[i] = _stable[i] = _raw[i] = false;
+        _rawMs[i] = _lockUntil[i] = 0;
+    }
 }
 
-// Init mutex and pins
+// Init pins and pin change interrupts
 void Buttons::begin()
 {
-    pinMode(_btn1, INPUT_PULLUP);
-    pinMode(_btn2, INPUT_PULLUP);
-    pinMode(_btn3, INPUT_PULLUP);
-    pinMode(_btn4, INPUT_PULLUP);
-
-    _mtx = xSemaphoreCreateMutex();
-    if (!_mtx)
-        LOG.log("Warning! Buttons mutex initialization failed.");
+    for (uint8_t i = 0; i < COUNT; i++)
+    {
+        pinMode(_pins[i], INPUT_PULLUP);
+        _isrDown[i] = _stable[i] = _raw[i] = digitalRead(_pins[i]) == LOW; // Initial level, no event
+        attachInterruptArg(_pins[i], _onEdge, &_isrArgs[i], CHANGE);
+    }
 }
-// Update state of button hardware
+
+// Update state of button hardware from queued edges
 void Buttons::update()
 {
-    // Button state read
-
-    bool b1 = digitalRead(_btn1) == LOW;
-    bool b2 = digitalRead(_btn2) == LOW;
-    bool b3 = digitalRead(_btn3) == LOW;
-    bool b4 = digitalRead(_btn4) == LOW;
+    uint32_t state = 0;
 
-    // Mutex lock for access to _currState
-    xSemaphoreTake(_mtx, portMAX_DELAY);
+    uint8_t tail = _edgeTail.load(std::memory_order_relaxed);
+    while (tail != _edgeHead.load(std::memory_order_acquire))
+    {
+        const Edge &e = _edges[tail];
+        _debounce(e.button, e.down, e.ms, state);
+        tail = (tail + 1) % EDGE_QUEUE_LEN;
+        _edgeTail.store(tail, std::memory_order_release);
+    }
 
-    _prevState = _currState;
+    // Edges were lost, the ISR still knows the latest level
+    if (_overflow.exchange(false))
+    {
+        for (uint8_t i = 0; i < COUNT; i++)
+        {
+            _raw[i] = _isrDown[i];
+            _rawMs[i] = millis();
+        }
+    }
 
-    // Update _currState
-    _currState.btn1.isDown = b1;
-    _currState.btn2.isDown = b2;
-    _currState.btn3.isDown = b3;
-    _currState.btn4.isDown = b4;
+    // Bounce that settled on the other level inside the lockout
+    uint32_t now = millis();
+    for (uint8_t i = 0; i < COUNT; i++)
+        if (_raw[i] != _stable[i] && (int32_t)(now - _lockUntil[i]) >= 0)
+            _commit(i, _raw[i], _rawMs[i], state);
 
-    _currState.btn1.pressed = b1 && !_prevState.btn1.isDown;
-    _currState.btn2.pressed = b2 && !_prevState.btn2.isDown;
-    _currState.btn3.pressed = b3 && !_prevState.btn3.isDown;
-    _currState.btn4.pressed = b4 && !_prevState.btn4.isDown;
+    for (uint8_t i = 0; i < COUNT; i++)
+        if (_stable[i])
+            state |= 1UL << (ButtonState::DOWN_SHIFT + i);
 
-    _currState.btn1.released = !b1 && _prevState.btn1.isDown;
-    _currState.btn2.released = !b2 && _prevState.btn2.isDown;
-    _currState.btn3.released = !b3 && _prevState.btn3.isDown;
-    _currState.btn4.released = !b4 && _prevState.btn4.isDown;
-    xSemaphoreGive(_mtx);
+    _currState.store(state, std::memory_order_release);
 }
 
 // Returns cached button state
 ButtonState Buttons::getState() const
 {
-    xSemaphoreTake(_mtx, portMAX_DELAY);
-    ButtonState bs = _currState;
-    xSemaphoreGive(_mtx);
-    return bs;
+    return ButtonState(_currState.load(std::memory_order_acquire));
+}
+
+bool Buttons::nextEvent(ButtonEvent &ev)
+{
+    if (_eventTail == _eventHead)
+        return false;
+    ev = _events[_eventTail];
+    _eventTail = (_eventTail + 1) % EVENT_QUEUE_LEN;
+    return true;
+}
+
+void Buttons::clearEvents()
+{
+    _eventTail = _eventHead;
+}
+
+//==================== Private helpers ====================
+
+// Pin change interrupt: queues the new level with a timestamp
+void IRAM_ATTR Buttons::_onEdge(void *arg)
+{
+    IsrArg *a = static_cast<IsrArg *>(arg);
+    Buttons *self = a->self;
+
+    bool down = digitalRead(self->_pins[a->button]) == LOW;
+    if (down == self->_isrDown[a->button]) // Bounced back before the interrupt ran
+        return;
+    self->_isrDown[a->button] = down;
+
+    uint8_t head = self->_edgeHead.load(std::memory_order_relaxed);
+    uint8_t next = (head + 1) % EDGE_QUEUE_LEN;
+    if (next == self->_edgeTail.load(std::memory_order_acquire))
+    {
+        self->_overflow.store(true, std::memory_order_relaxed);
+        return;
+    }
+    self->_edges[head] = {(uint32_t)millis(), a->button, down};
+    self->_edgeHead.store(next, std::memory_order_release);
+}
+
+// Lockout debounce: the first edge counts at once, edges within DEBOUNCE_MS are ignored
+void Buttons::_debounce(uint8_t button, bool down, uint32_t ms, uint32_t &state)
+{
+    // Level left over from a bounce that settled before this edge
+    if (_raw[button] != _stable[button] && (int32_t)(ms - _lockUntil[button]) >= 0)
+        _commit(button, _raw[button], _rawMs[button], state);
+
+    _raw[button] = down;
+    _rawMs[button] = ms;
+
+    if ((int32_t)(ms - _lockUntil[button]) < 0 || down == _stable[button])
+        return;
+    _commit(button, down, ms, state);
+}
+
+// Accepts a level change: queues the event and flags it in this update's snapshot
+void Buttons::_commit(uint8_t button, bool down, uint32_t ms, uint32_t &state)
+{
+    _stable[button] = down;
+    _lockUntil[button] = ms + DEBOUNCE_MS;
+
+    // Full queue drops the oldest event
+    uint8_t next = (_eventHead + 1) % EVENT_QUEUE_LEN;
+    if (next == _eventTail)
+        _eventTail = (_eventTail + 1) % EVENT_QUEUE_LEN;
+    _events[_eventHead] = {ms, button, down};
+    _eventHead = next;
+
+    state |= 1UL << ((down ? ButtonState::PRESSED_SHIFT : ButtonState::RELEASED_SHIFT) + button);
 }
\ No newline at end of file
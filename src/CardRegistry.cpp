@@ -0,0 +1,262 @@
+#include "CardRegistry.h"
+#include "Config.h"
+#include "Log.h"
+#include <algorithm>
+
+using namespace CardConfig;
+
+// Constructor
+CardRegistry::CardRegistry()
+    : _cards(), _count(0), _enrolling(false), _pending(), _mtx(NULL)
+{
+    memset(_slots, EMPTY_SLOT, sizeof(_slots));
+}
+
+void CardRegistry::begin()
+{
+    _mtx = xSemaphoreCreateMutex();
+    if (!_mtx)
+        LOG.log("Warning: CardRegistry mutex initialization failed.");
+
+    _prefs.begin("cards", true);
+    bool stored = _prefs.getBool("seeded", false);
+    size_t len = _prefs.isKey("table") ? _prefs.getBytesLength("table") : 0;
+    if (len % sizeof(Card) == 0 && len <= sizeof(_cards))
+        _count = _prefs.getBytes("table", _cards, len) / sizeof(Card);
+    _prefs.end();
+
+    if (!stored)
+    {
+        uint8_t uid[MAX_UID_LEN];
+        uint8_t uidLen = parseUID(ALARM_CARD_UID, uid);
+        if (uidLen)
+            add(uid, uidLen, CardAction::Dismiss);
+        else
+            LOG.log("No alarm card set, enroll one with the card command.");
+    }
+
+    _reindex();
+}
+
+bool CardRegistry::match(const uint8_t *uid, uint8_t len, Card &out) const
+{
+    xSemaphoreTake(_mtx, portMAX_DELAY);
+    int idx = _find(uid, len);
+    if (idx >= 0)
+        out = _cards[idx];
+    xSemaphoreGive(_mtx);
+    return idx >= 0;
+}
+
+uint8_t CardRegistry::count() const
+{
+    xSemaphoreTake(_mtx, portMAX_DELAY);
+    uint8_t n = _count;
+    xSemaphoreGive(_mtx);
+    return n;
+}
+
+bool CardRegistry::get(uint8_t idx, Card &out) const
+{
+    xSemaphoreTake(_mtx, portMAX_DELAY);
+    bool ok = idx < _count;
+    if (ok)
+        out = _cards[idx];
+    xSemaphoreGive(_mtx);
+    return ok;
+}
+
+bool CardRegistry::add(const uint8_t *uid, uint8_t len, CardAction action, const char *macro)
+{
+    if (len == 0 || len > MAX_UID_LEN)
+        return false;
+
+    xSemaphoreTake(_mtx, portMAX_DELAY);
+    int idx = _find(uid, len);
+    if (idx < 0)
+    {
+        if (_count >= MAX_CARDS)
+        {
+            xSemaphoreGive(_mtx);
+            return false;
+        }
+        idx = _count++;
+    }
+
+    // Re-enrolling a known card replaces its action
+    Card &c = _cards[idx];
+    memset(&c, 0, sizeof(c));
+    c.len = len;
+    memcpy(c.uid, uid, len);
+    c.action = action;
+    strncpy(c.macro, macro ? macro : "", MACRO_LEN - 1);
+
+    _reindex();
+    _save();
+    xSemaphoreGive(_mtx);
+    return true;
+}
+
+bool CardRegistry::remove(uint8_t idx)
+{
+    xSemaphoreTake(_mtx, portMAX_DELAY);
+    if (idx >= _count)
+    {
+        xSemaphoreGive(_mtx);
+        return false;
+    }
+
+    for (uint8_t i = idx; i + 1 < _count; i++)
+        _cards[i] = _cards[i + 1];
+    _count--;
+
+    _reindex();
+    _save();
+    xSemaphoreGive(_mtx);
+    return true;
+}
+
+void CardRegistry::startEnroll(CardAction action, const char *macro)
+{
+    xSemaphoreTake(_mtx, portMAX_DELAY);
+    memset(&_pending, 0, sizeof(_pending));
+    _pending.action = action;
+    strncpy(_pending.macro, macro ? macro : "", MACRO_LEN - 1);
+    _enrolling = true;
+    xSemaphoreGive(_mtx);
+}
+
+void CardRegistry::cancelEnroll()
+{
+    xSemaphoreTake(_mtx, portMAX_DELAY);
+    _enrolling = false;
+    xSemaphoreGive(_mtx);
+}
+
+bool CardRegistry::isEnrolling() const
+{
+    return _enrolling;
+}
+
+bool CardRegistry::completeEnroll(const uint8_t *uid, uint8_t len)
+{
+    xSemaphoreTake(_mtx, portMAX_DELAY);
+    Card pending = _pending;
+    _enrolling = false;
+    xSemaphoreGive(_mtx);
+    return add(uid, len, pending.action, pending.macro);
+}
+
+const char *CardRegistry::actionName(CardAction action)
+{
+    switch (action)
+    {
+    case CardAction::Dismiss:
+        return "dismiss";
+    case CardAction::ToggleAlarm:
+        return "toggle";
+    case CardAction::Command:
+        return "cmd";
+    default:
+        return "?";
+    }
+}
+
+// Hex string for display (not used for matching)
+void CardRegistry::formatUID(const uint8_t *uid, uint8_t len, char out[UID_STR_LEN])
+{
+    static const char HEX_DIGITS[] = "0123456789ABCDEF";
+    len = std::min(len, MAX_UID_LEN);
+    for (uint8_t i = 0; i < len; i++)
+    {
+        out[i * 2] = HEX_DIGITS[uid[i] >> 4];
+        out[i * 2 + 1] = HEX_DIGITS[uid[i] & 0x0F];
+    }
+    out[len * 2] = '\0';
+}
+
+uint8_t CardRegistry::parseUID(const char *hex, uint8_t out[MAX_UID_LEN])
+{
+    size_t n = strlen(hex);
+    if (n == 0 || n % 2 || n / 2 > MAX_UID_LEN)
+        return 0;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        char c = hex[i];
+        uint8_t v;
+        if (c >= '0' && c <= '9')
+            v = c - '0';
+        else if (c >= 'a' && c <= 'f')
+            v = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F')
+            v = c - 'A' + 10;
+        else
+            return 0;
+        out[i / 2] = (i % 2) ? (out[i / 2] | v) : (v << 4);
+    }
+    return n / 2;
+}
+
+//==================== Private helpers ====================
+
+// FNV-1a over the UID bytes
+uint32_t CardRegistry::_hash(const uint8_t *uid, uint8_t len)
+{
+    uint32_t h = 2166136261UL;
+    for (uint8_t i = 0; i < len; i++)
+        h = (h ^ uid[i]) * 16777619UL;
+    return h;
+}
+
+// Compares every byte regardless of where the first difference is
+bool CardRegistry::_equal(const Card &card, const uint8_t *uid, uint8_t len)
+{
+    uint8_t diff = card.len ^ len;
+    for (uint8_t i = 0; i < MAX_UID_LEN; i++)
+        diff |= card.uid[i] ^ (i < len ? uid[i] : 0);
+    return diff == 0;
+}
+
+// Linear probing from the UID's hash slot
+int CardRegistry::_find(const uint8_t *uid, uint8_t len) const
+{
+    if (len == 0 || len > MAX_UID_LEN)
+        return -1;
+
+    uint8_t slot = _hash(uid, len) & (SLOTS - 1);
+    for (uint8_t probe = 0; probe < SLOTS; probe++)
+    {
+        uint8_t idx = _slots[slot];
+        if (idx == EMPTY_SLOT)
+            return -1;
+        if (_equal(_cards[idx], uid, len))
+            return idx;
+        slot = (slot + 1) & (SLOTS - 1);
+    }
+    return -1;
+}
+
+// Rebuilds the hash index after the card list changed
+void CardRegistry::_reindex()
+{
+    memset(_slots, EMPTY_SLOT, sizeof(_slots));
+    for (uint8_t i = 0; i < _count; i++)
+    {
+        uint8_t slot = _hash(_cards[i].uid, _cards[i].len) & (SLOTS - 1);
+        while (_slots[slot] != EMPTY_SLOT)
+            slot = (slot + 1) & (SLOTS - 1);
+        _slots[slot] = i;
+    }
+}
+
+void CardRegistry::_save()
+{
+    _prefs.begin("cards", false);
+    if (_count)
+        _prefs.putBytes("table", _cards, _count * sizeof(Card));
+    else
+        _prefs.remove("table");
+    _prefs.putBool("seeded", true); // Don't enroll ALARM_CARD_UID again
+    _prefs.end();
+}
@@ -1,5 +1,6 @@
 #include "CommandInterface.h"
 #include "Config.h"
+#include "Settings.h"
 #include <Arduino.h>
 #include <cstring>
 
@@ -11,8 +12,17 @@ using namespace std;
     snprintf(_cmdOut + strlen(_cmdOut), CMD_OUT_SIZE - strlen(_cmdOut), fmt, ##__VA_ARGS__)
 
 // Constructor
-CommandInterface::CommandInterface(DFRobotDFPlayerMini &player, Timekeeper &tk, UI &ui, NetworkManager &net, AlarmSystem &alm)
-    : _player(player), _tk(tk), _ui(ui), _net(net), _alm(alm) {}
+CommandInterface::CommandInterface(AudioPlayer &player, TrackCatalog &tracks, Timekeeper &tk, UI &ui, NetworkManager &net, AlarmSystem &alm, BrightnessController &bright,
+                                   CardRegistry &cards, SpiBus &spi)
+    : _player(player), _tracks(tracks), _tk(tk), _ui(ui), _net(net), _alm(alm), _bright(bright), _cards(cards),
+      _spi(spi), _mtx(NULL) {}
+
+void CommandInterface::begin()
+{
+    _mtx = xSemaphoreCreateMutex();
+    if (!_mtx)
+        LOG.log("Warning: CommandInterface mutex initialization failed.");
+}
 
 // ========== CommandInterface member definitions ==========
 
@@ -71,8 +81,23 @@ const char *CommandInterface::handleBlynkIn(const char *line)
     {
         return "";
     }
+    xSemaphoreTake(_mtx, portMAX_DELAY);
     processCommandLine(buf);
-    return _cmdOut;
+    strcpy(_blynkOut, _cmdOut);
+    xSemaphoreGive(_mtx);
+    return _blynkOut;
+}
+
+// Called when a Command card is scanned
+void CommandInterface::handleCardIn(const char *macro)
+{
+    if (!macro || !*macro)
+        return;
+
+    char buf[CMD_IN_SIZE];
+    strncpy(buf, macro, sizeof(buf));
+    buf[sizeof(buf) - 1] = '\0';
+    runLocal(buf);
 }
 
 // Called every loop. Reads serial command line, converts into char* and passes to processor
@@ -90,8 +115,7 @@ void CommandInterface::handleSerialIn()
             if (inputPos > 0)
             {
                 inputBuffer[inputPos] = '\0';
-                processCommandLine(inputBuffer);
-                Serial.println(_cmdOut);
+                runLocal(inputBuffer);
                 inputPos = 0;
             }
         }
@@ -107,6 +131,20 @@ void CommandInterface::handleSerialIn()
     }
 }
 
+// Runs a serial or card line on the loop task. A Blynk command can hold the lock through a
+// network exchange, the loop doesn't wait for it.
+void CommandInterface::runLocal(char *line)
+{
+    if (xSemaphoreTake(_mtx, pdMS_TO_TICKS(LOCK_WAIT_MS)) != pdTRUE)
+    {
+        Serial.println("[CLK]: busy with a remote command, try again.");
+        return;
+    }
+    processCommandLine(line);
+    Serial.println(_cmdOut);
+    xSemaphoreGive(_mtx);
+}
+
 // Prints all available commands and usage
 void CommandInterface::cmdHelp(int argc, char *argv[])
 {
@@ -124,6 +162,28 @@ void CommandInterface::cmdStatus(int argc, char *argv[])
     DateTime now = _tk.time();
     CMD_APPEND("time: %02d:%02d:%02d\n", now.hour(), now.minute(), now.second());
     CMD_APPEND("date: %02d/%02d/%04d\n", now.month(), now.day(), now.year());
+
+    AudioPlayer::Stats a = _player.getStats();
+    CMD_APPEND("audio: %s, %lu sent, %lu coalesced, %lu dropped, %lu errors (last %u)\n",
+               _player.isOnline() ? "online" : "offline",
+               (unsigned long)a.sent, (unsigned long)a.coalesced, (unsigned long)a.dropped,
+               (unsigned long)a.errors, a.lastError);
+
+    uint32_t upS = millis() / 1000;
+    CMD_APPEND("display: %lu bytes pushed (%lu B/s avg, %s), %lu frames, %lu requests dropped, %lu coalesced\n", (unsigned long)_ui.getBytesPushed(),
+               (unsigned long)(upS ? _ui.getBytesPushed() / upS : 0), _ui.usesDMA() ? "DMA" : "no DMA",
+               (unsigned long)_ui.getFrames(), (unsigned long)_ui.getDroppedRequests(), (unsigned long)_ui.getCoalesced());
+
+    // Share of bus time per device since boot
+    uint64_t up = _spi.uptimeUs();
+    CMD_APPEND("spi: %lu reconfigs\n", (unsigned long)_spi.getReconfigs());
+    for (uint8_t i = 0; i < _spi.deviceCount(); i++)
+    {
+        const SpiDevice *dev = _spi.device(i);
+        SpiDevice::Stats s = dev->getStats();
+        CMD_APPEND("  %s @%lu kHz: %.2f%% busy, %lu ops, %lu ms waiting\n", dev->name(), (unsigned long)(dev->hz() / 1000),
+                   up ? 100.0 * s.busyUs / up : 0.0, (unsigned long)s.operations, (unsigned long)(s.waitUs / 1000));
+    }
 }
 
 void CommandInterface::cmdTime(int argc, char *argv[])
@@ -301,12 +361,12 @@ void CommandInterface::cmdLog(int argc, char *argv[])
     }
 }
 
-// Either sets alarm at given time, or disables alarm
+// Manages the alarm table: primary alarm shortcuts plus recurring/one-shot alarms
 void CommandInterface::cmdAlarm(int argc, char *argv[])
 {
     if (argc < 2)
     {
-        CMD_APPEND("Usage: alarm <set hr min> || <disable>");
+        CMD_APPEND("Usage: alarm <set hr min> || <add hr min [days]> || <list> || <remove n> || <skip n> || <enable n> || <disable [n]> || <stage n s> || <ramp [min] [sync|nosync]>");
         return;
     }
 
@@ -318,45 +378,156 @@ void CommandInterface::cmdAlarm(int argc, char *argv[])
             return;
         }
 
-        // Convert strings to ints with validation
-        char *endptr_hr;
-        long hr = strtol(argv[2], &endptr_hr, 10);
+        uint8_t hr, min;
+        if (!parseAlarmTime(argv[2], argv[3], hr, min))
+            return;
+
+        _alm.setAlarm(hr, min, true);
+        CMD_APPEND("Alarm set to %02d:%02d", hr, min);
+    }
+    else if (strcmp(argv[1], "add") == 0)
+    {
+        if (argc < 4 || argc > 5)
+        {
+            CMD_APPEND("Usage: alarm add <hr> <min> [once || daily || weekdays || weekends || days 0-6 (0 = Sun, ex: 135)]");
+            return;
+        }
 
-        char *endptr_min;
-        long min = strtol(argv[3], &endptr_min, 10);
+        AlarmTime a = {0, 0, true, AlarmConfig::EVERY_DAY, false, 0};
+        if (!parseAlarmTime(argv[2], argv[3], a.hour, a.minute))
+            return;
+        if (argc == 5 && !parseDays(argv[4], a.days))
+            return;
 
-        // Check if conversion was successful and consumed the whole string
-        if (endptr_hr == argv[2] || *endptr_hr != '\0' ||
-            endptr_min == argv[3] || *endptr_min != '\0')
+        int idx = _alm.addAlarm(a);
+        if (idx < 0)
         {
-            CMD_APPEND("Err: hour and minute must be valid numbers");
+            CMD_APPEND("Err: alarm table is full (max %d)", AlarmConfig::MAX_ALARMS);
             return;
         }
 
-        // Verify arg range
-        if (hr < 0 || hr > 23)
+        char days[10];
+        formatDays(a.days, days);
+        CMD_APPEND("Alarm %d added: %02d:%02d %s", idx, a.hour, a.minute, days);
+    }
+    else if (strcmp(argv[1], "list") == 0)
+    {
+        uint8_t count = _alm.alarmCount();
+        if (count == 0)
         {
-            CMD_APPEND("Err: hour must be between 0 and 23");
+            CMD_APPEND("No alarms set.");
             return;
         }
 
-        if (min < 0 || min > 59)
+        for (uint8_t i = 0; i < count; i++)
         {
-            CMD_APPEND("Err: minute must be between 0 and 59");
+            AlarmTime a;
+            if (!_alm.getAlarm(i, a))
+                break;
+
+            char days[10];
+            formatDays(a.days, days);
+            CMD_APPEND("%d: %02d:%02d %s %s stage %d%s\n", i, a.hour, a.minute, days,
+                       a.enabled ? "on" : "off", a.stage, a.skipNext ? " (skip next)" : "");
+        }
+
+        AlarmTime next;
+        DateTime when;
+        if (_alm.getNextAlarm(next, when))
+            CMD_APPEND("next: %02d/%02d %02d:%02d", when.month(), when.day(), when.hour(), when.minute());
+    }
+    else if (strcmp(argv[1], "stage") == 0)
+    {
+        long idx, stage;
+        AlarmTime a;
+        if (argc != 4)
+        {
+            CMD_APPEND("Usage: alarm stage <n> <escalation stage>");
+            return;
+        }
+        if (!parseLong(argv[2], idx, "alarm index") || !parseLong(argv[3], stage, "stage"))
+            return;
+        if (idx < 0 || !_alm.getAlarm((uint8_t)idx, a))
+        {
+            CMD_APPEND("Err: no alarm %ld", idx);
+            return;
+        }
+        if (stage < 0 || stage >= AlarmConfig::MAX_STAGES)
+        {
+            CMD_APPEND("Err: stage must be between 0 and %d", AlarmConfig::MAX_STAGES - 1);
             return;
         }
 
-        _alm.setAlarm((int)hr, (int)min, true);
-        CMD_APPEND("Alarm set to %02d:%02d", hr, min);
+        a.stage = (uint8_t)stage;
+        _alm.setAlarm((uint8_t)idx, a);
+        CMD_APPEND("Alarm %ld starts at escalation stage %ld", idx, stage);
     }
-    else if (strcmp(argv[1], "disable") == 0)
+    else if (strcmp(argv[1], "ramp") == 0)
+    {
+        bool sync;
+        long minutes = _alm.getWakeRamp(sync);
+        if (argc >= 3 && !parseLong(argv[2], minutes, "minutes"))
+            return;
+        if (minutes < 0 || minutes > AlarmConfig::MAX_WAKE_RAMP_MIN)
+        {
+            CMD_APPEND("Err: ramp must be between 0 and %d minutes", AlarmConfig::MAX_WAKE_RAMP_MIN);
+            return;
+        }
+        if (argc >= 4)
+            sync = strcmp(argv[3], "sync") == 0;
+
+        if (argc >= 3)
+            _alm.setWakeRamp((uint8_t)minutes, sync);
+
+        if (minutes == 0)
+            CMD_APPEND("Wake ramp off");
+        else
+            CMD_APPEND("Wake ramp: %ld min before each alarm, backlight %s", minutes, sync ? "synced" : "unchanged");
+    }
+    else if (strcmp(argv[1], "disable") == 0 && argc == 2)
     {
         _alm.setAlarm(0, 0, false);
         CMD_APPEND("Alarm disabled");
     }
+    else if (strcmp(argv[1], "remove") == 0 || strcmp(argv[1], "skip") == 0 ||
+             strcmp(argv[1], "enable") == 0 || strcmp(argv[1], "disable") == 0)
+    {
+        long idx;
+        if (argc != 3)
+        {
+            CMD_APPEND("Usage: alarm %s <n>   (see alarm list)", argv[1]);
+            return;
+        }
+        if (!parseLong(argv[2], idx, "alarm index"))
+            return;
+
+        AlarmTime a;
+        if (idx < 0 || !_alm.getAlarm((uint8_t)idx, a))
+        {
+            CMD_APPEND("Err: no alarm %ld", idx);
+            return;
+        }
+
+        if (strcmp(argv[1], "remove") == 0)
+        {
+            _alm.removeAlarm((uint8_t)idx);
+            CMD_APPEND("Alarm %ld removed", idx);
+        }
+        else if (strcmp(argv[1], "skip") == 0)
+        {
+            _alm.skipNext((uint8_t)idx, !a.skipNext);
+            CMD_APPEND("Alarm %ld will %s its next occurrence", idx, a.skipNext ? "ring at" : "skip");
+        }
+        else
+        {
+            a.enabled = strcmp(argv[1], "enable") == 0;
+            _alm.setAlarm((uint8_t)idx, a);
+            CMD_APPEND("Alarm %ld %s", idx, a.enabled ? "enabled" : "disabled");
+        }
+    }
     else
     {
-        CMD_APPEND("Usage: alarm <set hr min> || <disable>");
+        CMD_APPEND("Usage: alarm <set hr min> || <add hr min [days]> || <list> || <remove n> || <skip n> || <enable n> || <disable [n]> || <stage n s> || <ramp [min] [sync|nosync]>");
     }
 }
 
@@ -365,7 +536,7 @@ void CommandInterface::cmdAlarmType(int argc, char *argv[])
 {
     if (argc < 2)
     {
-        CMD_APPEND("Usage: alarmtype <loud || normal || buzzer || all || int(trackNumber)> <vol>");
+        CMD_APPEND("Usage: alarmtype <loud || normal || buzzer || all || int(trackNumber)> <vol> [shuffle || random]");
         return;
     }
 
@@ -390,6 +561,14 @@ void CommandInterface::cmdAlarmType(int argc, char *argv[])
             CMD_APPEND("Err: invalid alarm type.");
             return;
         }
+        // Stage tracks are 8 bit, and the card's total is the limit once it's known
+        uint16_t files = _tracks.trackCount(TrackConfig::ALL);
+        long maxTrack = files ? std::min<long>(files, 255) : 255;
+        if (val > maxTrack)
+        {
+            CMD_APPEND("Err: track must be between 1 and %ld", maxTrack);
+            return;
+        }
         alarmType = 4;
         trackNum = (int)val;
     }
@@ -407,36 +586,124 @@ void CommandInterface::cmdAlarmType(int argc, char *argv[])
         volume = (int)v;
     }
 
+    uint8_t mode = TrackConfig::SHUFFLE;
+    if (argc >= 4)
+    {
+        if (strcmp(argv[3], "random") == 0)
+            mode = TrackConfig::RANDOM;
+        else if (strcmp(argv[3], "shuffle") != 0)
+        {
+            CMD_APPEND("Err: play order must be shuffle or random");
+            return;
+        }
+    }
+
+    // Alarm sound is the first escalation stage
+    EscalationStage stage;
+    _alm.getStage(0, stage);
+
     CMD_APPEND("Alarm set to play ");
     // Perform action
+    stage.track = 0;
     if (alarmType == 0)
     {
-        _alm.trackRange = Tracks::loudSongs;
+        stage.category = TrackConfig::LOUD_SONGS;
         CMD_APPEND("loud songs ");
     }
     if (alarmType == 1)
     {
-        _alm.trackRange = Tracks::normalSongs;
+        stage.category = TrackConfig::NORMAL_SONGS;
         CMD_APPEND("normal songs ");
     }
     if (alarmType == 2)
     {
-        _alm.trackRange = Tracks::buzzers;
+        stage.category = TrackConfig::BUZZERS;
         CMD_APPEND("buzzers ");
     }
     if (alarmType == 3)
     {
-        _alm.trackRange = Tracks::allSongs;
+        stage.category = TrackConfig::ALL;
         CMD_APPEND("all songs ");
     }
     if (alarmType == 4)
     {
-        _alm.trackRange = {int(argv[1]), int(argv[1])};
-        CMD_APPEND("track %s ", argv[1]);
+        stage.category = TrackConfig::ALL;
+        stage.track = (uint8_t)trackNum;
+        CMD_APPEND("track %d ", trackNum);
     }
 
-    _alm.normalVol = volume;
+    stage.mode = mode;
+    stage.startVol = volume;
+    _alm.setStage(0, stage);
     CMD_APPEND("at volume %d", volume);
+    if (alarmType != 4)
+        CMD_APPEND(", %s", mode == TrackConfig::SHUFFLE ? "shuffled" : "random order");
+}
+
+// Lists or edits the ringing escalation table
+void CommandInterface::cmdEscalation(int argc, char *argv[])
+{
+    if (argc < 2 || strcmp(argv[1], "list") == 0)
+    {
+        for (uint8_t i = 0; i < AlarmConfig::MAX_STAGES; i++)
+        {
+            EscalationStage st;
+            _alm.getStage(i, st);
+            CMD_APPEND("%d: category %d track %d %s vol %d ramp %d/min %ds -> %d\n", i,
+                       st.category, st.track, st.mode == TrackConfig::SHUFFLE ? "shuffle" : "random",
+                       st.startVol, st.rampPerMin, st.durationSec, st.next);
+        }
+        return;
+    }
+
+    if (strcmp(argv[1], "set") != 0 || argc < 5)
+    {
+        CMD_APPEND("Usage: escalation <list> || <set stage <category c [track]> || <vol 0-30> || <ramp steps/min> || <duration sec> || <next stage>>");
+        return;
+    }
+
+    long idx, v;
+    if (!parseLong(argv[2], idx, "stage") || !parseLong(argv[4], v, "value"))
+        return;
+
+    EscalationStage st;
+    if (idx < 0 || !_alm.getStage((uint8_t)idx, st))
+    {
+        CMD_APPEND("Err: stage must be between 0 and %d", AlarmConfig::MAX_STAGES - 1);
+        return;
+    }
+
+    if (strcmp(argv[3], "category") == 0)
+    {
+        long track = 0;
+        if (argc == 6 && !parseLong(argv[5], track, "track"))
+            return;
+        if (v < 0 || v > TrackConfig::MAX_CATEGORIES || track < 0 || track > 255)
+        {
+            CMD_APPEND("Err: category must be 0-%d, track 0-255 (0 = random)", TrackConfig::MAX_CATEGORIES);
+            return;
+        }
+        st.category = (uint8_t)v;
+        st.track = (uint8_t)track;
+    }
+    else if (strcmp(argv[3], "vol") == 0 && v >= 0 && v <= 30)
+        st.startVol = (uint8_t)v;
+    else if (strcmp(argv[3], "ramp") == 0 && v >= 0 && v <= 60)
+        st.rampPerMin = (uint8_t)v;
+    else if (strcmp(argv[3], "duration") == 0 && v >= 0 && v <= 65535)
+        st.durationSec = (uint16_t)v;
+    else if (strcmp(argv[3], "next") == 0 && v >= 0 && v < AlarmConfig::MAX_STAGES)
+        st.next = (uint8_t)v;
+    else
+    {
+        CMD_APPEND("Err: field/value invalid (category 0-%d, vol 0-30, ramp 0-60, duration 0-65535, next 0-%d)",
+                   TrackConfig::MAX_CATEGORIES, AlarmConfig::MAX_STAGES - 1);
+        return;
+    }
+
+    _alm.setStage((uint8_t)idx, st);
+    CMD_APPEND("Stage %ld: category %d track %d vol %d ramp %d/min %ds -> %d", idx,
+               st.category, st.track, st.startVol, st.rampPerMin, st.durationSec, st.next);
 }
 
 // Sets audio volume to given int
@@ -459,7 +726,19 @@ void CommandInterface::cmdVol(int argc, char *argv[])
     }
     v = (int)v;
 
-    _player.volume(v);
+    // A ringing alarm is only turned up or down, the saved volume is for everything else
+    if (_alm.isRinging())
+    {
+        _player.volume(v);
+        CMD_APPEND("Alarm volume set to %d", v);
+        return;
+    }
+
+    // Kept across reboots, the settings hook applies it. Unchanged, it is re-sent as is.
+    if (SETTINGS.get(Setting::Volume) == v)
+        _player.volume(v);
+    else
+        SETTINGS.set(Setting::Volume, v);
     CMD_APPEND("Volume set to %d", v);
 }
 
@@ -529,6 +808,283 @@ void CommandInterface::cmdStop(int argc, char *argv[])
     CMD_APPEND("Ok: Audio playback stopped.");
 }
 
+// Lists SD card track categories, or re-reads them from the player
+void CommandInterface::cmdTracks(int argc, char *argv[])
+{
+    if (argc >= 2)
+    {
+        if (strcmp(argv[1], "rescan") != 0)
+        {
+            CMD_APPEND("Usage: tracks [rescan]");
+            return;
+        }
+        if (!_tracks.rescan())
+        {
+            CMD_APPEND("Err: player did not answer");
+            return;
+        }
+    }
+
+    CMD_APPEND("%d files, %d folders%s\n", _tracks.trackCount(TrackConfig::ALL), _tracks.categoryCount(),
+               _tracks.fromCache() ? " (cached)" : "");
+    for (uint8_t c = 1; c <= _tracks.categoryCount(); c++)
+        CMD_APPEND("%02d: %d tracks\n", c, _tracks.trackCount(c));
+}
+
+// Shows or edits the shuffled playlist of a track category
+void CommandInterface::cmdPlaylist(int argc, char *argv[])
+{
+    long category;
+    if (argc < 2 || !parseLong(argv[1], category, "category"))
+    {
+        CMD_APPEND("Usage: playlist <category> [reshuffle || weight <track> <0-%d>]", PlaylistConfig::MAX_WEIGHT);
+        return;
+    }
+
+    TrackCatalog::PlaylistInfo info;
+    bool known = category >= 0 && category <= TrackConfig::MAX_CATEGORIES;
+    if (!known || !_tracks.playlistInfo((uint8_t)category, info))
+    {
+        CMD_APPEND("Err: category %ld has no tracks or more than %d (played at random)", category, PlaylistConfig::MAX_TRACKS);
+        return;
+    }
+
+    if (argc >= 3 && strcmp(argv[2], "reshuffle") == 0)
+    {
+        _tracks.reshuffle((uint8_t)category);
+        CMD_APPEND("Category %ld reshuffled\n", category);
+    }
+    else if (argc == 5 && strcmp(argv[2], "weight") == 0)
+    {
+        long track, weight;
+        if (!parseLong(argv[3], track, "track") || !parseLong(argv[4], weight, "weight"))
+            return;
+        if (track < 1 || track > 255 || weight < 0 || weight > 255 ||
+            !_tracks.setWeight((uint8_t)category, (uint8_t)track, (uint8_t)weight))
+        {
+            CMD_APPEND("Err: track must be in category, weight 0-%d", PlaylistConfig::MAX_WEIGHT);
+            return;
+        }
+        CMD_APPEND("Track %ld weight %ld (from next cycle)\n", track, weight);
+    }
+    else if (argc >= 3)
+    {
+        CMD_APPEND("Usage: playlist <category> [reshuffle || weight <track> <0-%d>]", PlaylistConfig::MAX_WEIGHT);
+        return;
+    }
+
+    _tracks.playlistInfo((uint8_t)category, info); // After the change
+    CMD_APPEND("%d of %d left this cycle\nweights:", info.remaining, info.length);
+    for (uint8_t t = 0; t < info.count; t++)
+        CMD_APPEND(" %d", info.weights[t]);
+}
+
+// Nudges the backlight for the current room light (teaching the ambient curve) or shows the curve
+void CommandInterface::cmdBrightness(int argc, char *argv[])
+{
+    using namespace BrightnessConfig;
+
+    if (argc >= 2 && (strcmp(argv[1], "up") == 0 || strcmp(argv[1], "down") == 0))
+    {
+        long step = NUDGE_STEP;
+        if (argc >= 3 && !parseLong(argv[2], step, "step"))
+            return;
+        if (step < 1 || step > BRIGHTNESS_MAX)
+        {
+            CMD_APPEND("Err: step must be between 1 and %d", BRIGHTNESS_MAX);
+            return;
+        }
+        if (!_bright.nudge(argv[1][0] == 'u' ? step : -step))
+        {
+            CMD_APPEND("Err: no light reading yet");
+            return;
+        }
+        CMD_APPEND("Brightness %d at %.0f mV, curve updated\n", _bright.getTargetBrightness(), _bright.getLightMv());
+        return;
+    }
+    if (argc >= 2 && strcmp(argv[1], "reset") == 0)
+    {
+        _bright.resetCurve();
+        CMD_APPEND("Curve reset to factory\n");
+        return;
+    }
+    if (argc >= 2 && strcmp(argv[1], "curve") != 0)
+    {
+        CMD_APPEND("Usage: brightness [up [n] || down [n] || curve || reset]");
+        return;
+    }
+
+    CMD_APPEND("brightness %d (target %d), light %.0f mV ~%.0f lux\n", _bright.getBrightness(),
+               _bright.getTargetBrightness(), _bright.getLightMv(), _bright.getLux());
+    if (argc < 2)
+        return;
+
+    CMD_APPEND("curve (mV:level):");
+    for (uint8_t k = 0; k < CURVE_KNOTS; k++)
+        CMD_APPEND(" %lu:%d", (unsigned long)(k * KNOT_MV), _bright.getKnot(k));
+
+    BrightnessController::Correction fixes[MAX_CORRECTIONS];
+    uint8_t n = _bright.getCorrections(fixes, MAX_CORRECTIONS);
+    CMD_APPEND("\ncorrections:%s", n ? "" : " none");
+    for (uint8_t i = 0; i < n; i++)
+        CMD_APPEND(" %lu:%d", (unsigned long)fixes[i].bin * CURVE_MV_SPAN / 256, fixes[i].level);
+}
+
+// Times drawing the clock digits with the font and from the glyph cache
+void CommandInterface::cmdBench(int argc, char *argv[])
+{
+    long runs = 10;
+    if (argc >= 2 && !parseLong(argv[1], runs, "runs"))
+        return;
+    if (runs < 1 || runs > 100)
+    {
+        CMD_APPEND("Err: runs must be between 1 and 100");
+        return;
+    }
+
+    UI::TimeBenchmark b;
+    if (!_ui.benchmarkTime(runs, b))
+    {
+        CMD_APPEND("Err: display did not respond");
+        return;
+    }
+    CMD_APPEND("HH:MM x%u: font %lu us per draw\n", b.runs, (unsigned long)b.fontUs);
+    if (b.cachedUs)
+        CMD_APPEND("glyph cache %lu us per draw (%.1fx), %lu bytes\n", (unsigned long)b.cachedUs,
+                   (float)b.fontUs / b.cachedUs, (unsigned long)b.cacheBytes);
+    else
+        CMD_APPEND("glyph cache unavailable\n");
+}
+
+// Lists, enrolls or removes RFID cards
+void CommandInterface::cmdCard(int argc, char *argv[])
+{
+    using namespace CardConfig;
+
+    if (argc < 2 || strcmp(argv[1], "list") == 0)
+    {
+        CMD_APPEND("%u/%u cards%s\n", _cards.count(), MAX_CARDS, _cards.isEnrolling() ? ", enrolling" : "");
+        Card card;
+        for (uint8_t i = 0; _cards.get(i, card); i++)
+        {
+            char hex[UID_STR_LEN];
+            CardRegistry::formatUID(card.uid, card.len, hex);
+            CMD_APPEND("%u: %s %s%s%s\n", i, hex, CardRegistry::actionName(card.action),
+                       card.action == CardAction::Command ? " " : "", card.macro);
+        }
+        return;
+    }
+
+    if (strcmp(argv[1], "enroll") == 0 && argc >= 3)
+    {
+        if (strcmp(argv[2], "dismiss") == 0)
+            _cards.startEnroll(CardAction::Dismiss);
+        else if (strcmp(argv[2], "toggle") == 0)
+            _cards.startEnroll(CardAction::ToggleAlarm);
+        else if (strcmp(argv[2], "cmd") == 0 && argc >= 4)
+        {
+            // Rejoin the tokenized command line
+            char macro[MACRO_LEN] = "";
+            for (int i = 3; i < argc; i++)
+            {
+                if (strlen(macro) + strlen(argv[i]) + 1 >= MACRO_LEN)
+                {
+                    CMD_APPEND("Err: command longer than %u characters", MACRO_LEN - 1);
+                    return;
+                }
+                if (i > 3)
+                    strcat(macro, " ");
+                strcat(macro, argv[i]);
+            }
+            if (strcmp(argv[3], "card") == 0)
+            {
+                CMD_APPEND("Err: card commands can't run card commands");
+                return;
+            }
+            _cards.startEnroll(CardAction::Command, macro);
+        }
+        else
+        {
+            CMD_APPEND("Usage: card enroll dismiss || toggle || cmd <command...>");
+            return;
+        }
+        CMD_APPEND("Scan the card to enroll");
+        return;
+    }
+
+    if (strcmp(argv[1], "remove") == 0 && argc >= 3)
+    {
+        long idx;
+        if (!parseLong(argv[2], idx, "card"))
+            return;
+        if (idx < 0 || idx >= _cards.count() || !_cards.remove(idx))
+        {
+            CMD_APPEND("Err: no card %ld", idx);
+            return;
+        }
+        CMD_APPEND("Card %ld removed%s", idx, _cards.count() ? "" : ", any card dismisses until one is enrolled");
+        return;
+    }
+
+    if (strcmp(argv[1], "cancel") == 0)
+    {
+        _cards.cancelEnroll();
+        CMD_APPEND("Enrollment cancelled");
+        return;
+    }
+
+    CMD_APPEND("Usage: card <list> || <enroll dismiss || toggle || cmd <command...>> || <remove n> || <cancel>");
+}
+
+// Lists, reads or changes persistent settings
+void CommandInterface::cmdConfig(int argc, char *argv[])
+{
+    if (argc < 2 || strcmp(argv[1], "list") == 0)
+    {
+        for (uint8_t i = 0; i < (uint8_t)Setting::Count; i++)
+        {
+            int32_t min, max;
+            SETTINGS.range((Setting)i, min, max);
+            CMD_APPEND("%s = %ld (%ld-%ld)\n", SETTINGS.name((Setting)i), (long)SETTINGS.get((Setting)i), (long)min, (long)max);
+        }
+        return;
+    }
+
+    Setting id;
+    if (argc < 3 || !SETTINGS.find(argv[2], id))
+    {
+        CMD_APPEND("Usage: config <list> || <get name> || <set name value> || <reset name>");
+        return;
+    }
+
+    if (strcmp(argv[1], "get") == 0)
+        CMD_APPEND("%s = %ld", SETTINGS.name(id), (long)SETTINGS.get(id));
+    else if (strcmp(argv[1], "reset") == 0)
+    {
+        SETTINGS.reset(id);
+        CMD_APPEND("%s reset to %ld", SETTINGS.name(id), (long)SETTINGS.get(id));
+    }
+    else if (strcmp(argv[1], "set") == 0 && argc == 4)
+    {
+        long v;
+        if (SETTINGS.type(id) == SettingType::Bool && (strcmp(argv[3], "on") == 0 || strcmp(argv[3], "off") == 0))
+            v = strcmp(argv[3], "on") == 0;
+        else if (!parseLong(argv[3], v, SETTINGS.name(id)))
+            return;
+
+        int32_t min, max;
+        SETTINGS.range(id, min, max);
+        if (!SETTINGS.set(id, v))
+        {
+            CMD_APPEND("Err: %s must be between %ld and %ld", SETTINGS.name(id), (long)min, (long)max);
+            return;
+        }
+        CMD_APPEND("%s = %ld", SETTINGS.name(id), v);
+    }
+    else
+        CMD_APPEND("Usage: config <list> || <get name> || <set name value> || <reset name>");
+}
+
 // Starts/stops persistent wifi session (useful for live remote commands)
 void CommandInterface::cmdWiFiSession(int argc, char *argv[])
 {
@@ -541,7 +1097,7 @@ void CommandInterface::cmdWiFiSession(int argc, char *argv[])
     {
         if (!_net.isWiFiPersistent())
         {
-            _net.setWiFiPersistent(true);
+            SETTINGS.set(Setting::WiFiPersistent, true);
             CMD_APPEND("Wifi session started.\nBLynk Polling frequency is set to continuous.");
         }
         else
@@ -551,7 +1107,7 @@ void CommandInterface::cmdWiFiSession(int argc, char *argv[])
     {
         if (_net.isWiFiPersistent())
         {
-            _net.setWiFiPersistent(false);
+            SETTINGS.set(Setting::WiFiPersistent, false);
             CMD_APPEND("Wifi session stopped.\n BLynk Polling frequency is set to every :00 & :30.");
         }
         else
@@ -607,4 +1163,71 @@ bool CommandInterface::parseLong(char *arg, long &out, const char *name)
     }
 
     return true;
-}
\ No newline at end of file
+}
+
+// Parses and range checks an alarm hour and minute
+bool CommandInterface::parseAlarmTime(char *hrArg, char *minArg, uint8_t &hr, uint8_t &min)
+{
+    long h, m;
+    if (!parseLong(hrArg, h, "hour") || !parseLong(minArg, m, "minute"))
+        return false;
+
+    if (h < 0 || h > 23)
+    {
+        CMD_APPEND("Err: hour must be between 0 and 23");
+        return false;
+    }
+
+    if (m < 0 || m > 59)
+    {
+        CMD_APPEND("Err: minute must be between 0 and 59");
+        return false;
+    }
+
+    hr = (uint8_t)h;
+    min = (uint8_t)m;
+    return true;
+}
+
+// Parses a repeat day spec: once, daily, weekdays, weekends, or a list of day digits (0 = Sunday)
+bool CommandInterface::parseDays(char *arg, uint8_t &out)
+{
+    if (strcmp(arg, "once") == 0)
+        out = AlarmConfig::ONE_SHOT;
+    else if (strcmp(arg, "daily") == 0)
+        out = AlarmConfig::EVERY_DAY;
+    else if (strcmp(arg, "weekdays") == 0)
+        out = AlarmConfig::WEEKDAYS;
+    else if (strcmp(arg, "weekends") == 0)
+        out = AlarmConfig::WEEKENDS;
+    else
+    {
+        out = 0;
+        for (char *p = arg; *p; ++p)
+        {
+            if (*p < '0' || *p > '6')
+            {
+                CMD_APPEND("Err: days must be once, daily, weekdays, weekends or digits 0-6");
+                return false;
+            }
+            out |= 1 << (*p - '0');
+        }
+    }
+    return true;
+}
+
+// Formats a repeat day mask as "once", "daily", or a 7 letter SMTWTFS mask
+void CommandInterface::formatDays(uint8_t days, char out[10])
+{
+    if (days == AlarmConfig::ONE_SHOT)
+        strcpy(out, "once");
+    else if (days == AlarmConfig::EVERY_DAY)
+        strcpy(out, "daily");
+    else
+    {
+        const char *letters = "SMTWTFS";
+        for (uint8_t d = 0; d < 7; d++)
+            out[d] = (days & (1 << d)) ? letters[d] : '-';
+        out[7] = '\0';
+    }
+}
@@ -0,0 +1,184 @@
+#include "DisplayPower.h"
+#include "Settings.h"
+
+using namespace DisplayPowerConfig;
+
+// Constructor
+DisplayPower::DisplayPower(TFT_eSPI &tft, SpiDevice &spi, BrightnessController &bright, Timekeeper &tk)
+    : _tft(tft), _spi(spi), _bright(bright), _tk(tk),
+      _state(PowerState::On), _held(false), _dark(false), _idleMode(false), _asleep(false),
+      _lastActivity(0), _lastPolicy(0), _awakeSince(0)
+{
+}
+
+void DisplayPower::begin()
+{
+    _lastActivity = millis();
+    _awakeSince = millis();
+}
+
+void DisplayPower::run()
+{
+    unsigned long now = millis();
+    if (now - _lastPolicy < POLICY_INTERVAL_MS)
+        return;
+    _lastPolicy = now;
+
+    PowerState target = _policy(now - _lastActivity);
+    if (target == _state)
+        return;
+
+    // Waking is immediate, going down is one state per evaluation so the backlight
+    // reaches its new cap before the panel goes further
+    if (target > _state)
+        target = (PowerState)((uint8_t)_state + 1);
+
+    // Panel sleep only once the backlight is out
+    if (target == PowerState::Sleep &&
+        (_bright.getBrightness() != 0 || _bright.isFading() || now - _awakeSince < SLPOUT_TO_SLPIN_MS))
+        return;
+
+    _apply(target);
+}
+
+bool DisplayPower::wake()
+{
+    bool wasDark = isDark();
+    _lastActivity = millis();
+    if (_state != PowerState::On)
+        _apply(PowerState::On);
+    return wasDark;
+}
+
+void DisplayPower::hold(bool on)
+{
+    _held = on;
+    if (on)
+        wake();
+    else
+        _lastActivity = millis(); // Full dim timeout after an alarm
+}
+
+PowerState DisplayPower::getState() const { return _state; }
+bool DisplayPower::isDark() const { return _state >= PowerState::BacklightOff; }
+
+const char *DisplayPower::stateName(PowerState state)
+{
+    switch (state)
+    {
+    case PowerState::On:
+        return "on";
+    case PowerState::Dim:
+        return "dim";
+    case PowerState::Idle:
+        return "idle";
+    case PowerState::BacklightOff:
+        return "backlight off";
+    case PowerState::Sleep:
+        return "sleep";
+    default:
+        return "?";
+    }
+}
+
+//==================== Private helpers ====================
+
+// Deepest state allowed for the current inactivity, light level and time
+PowerState DisplayPower::_policy(unsigned long inactiveMs)
+{
+    if (_held)
+        return PowerState::On;
+
+    if (_bright.getLightMv() >= 0)
+    {
+        float lux = _bright.getLux();
+        if (_dark && lux > LIGHT_LUX)
+            _dark = false;
+        else if (!_dark && lux < DARK_LUX)
+            _dark = true;
+    }
+
+    if (inactiveMs < (unsigned long)SETTINGS.get(Setting::DisplayDimSec) * 1000UL)
+        return PowerState::On;
+
+    // A lit room during the day keeps the ambient brightness, dimming there only makes the clock hard to read
+    bool night = _inNight();
+    if (!_dark && !night)
+        return PowerState::On;
+
+    if (_dark && night)
+    {
+        if (inactiveMs >= SLEEP_AFTER_MS)
+            return PowerState::Sleep;
+        if (inactiveMs >= OFF_AFTER_MS)
+            return PowerState::BacklightOff;
+    }
+    if (inactiveMs >= IDLE_AFTER_MS)
+        return PowerState::Idle;
+    return PowerState::Dim;
+}
+
+// Whether the time is inside the night window (which may wrap past midnight)
+bool DisplayPower::_inNight() const
+{
+    uint16_t start = SETTINGS.get(Setting::NightStart);
+    uint16_t end = SETTINGS.get(Setting::NightEnd);
+    if (start == end)
+        return false;
+
+    DateTime t = _tk.time();
+    uint16_t m = t.hour() * 60 + t.minute();
+    return start < end ? (m >= start && m < end) : (m >= start || m < end);
+}
+
+// Moves panel and backlight to a state. Panel comes up before the UI repaints and the
+// backlight turns on, going down the backlight goes first.
+void DisplayPower::_apply(PowerState target)
+{
+    static const uint8_t LIMITS[] = {BrightnessConfig::BRIGHTNESS_MAX, DIM_LEVEL, IDLE_LEVEL, 0, 0};
+
+    SpiDevice::Lock bus(_spi); // Panel commands and the repaint in one go
+
+    if (target < _state)
+    {
+        if (_asleep && target < PowerState::Sleep)
+        {
+            _tft.writecommand(CMD_SLPOUT);
+            delay(SLPOUT_SETTLE_MS);
+            _asleep = false;
+            _awakeSince = millis();
+        }
+        bool idle = target == PowerState::Idle || target == PowerState::BacklightOff;
+        if (_idleMode != idle)
+        {
+            _tft.writecommand(idle ? CMD_IDMON : CMD_IDMOFF);
+            _idleMode = idle;
+        }
+
+        _state = target;
+        if (_onStateChange)
+            _onStateChange(_state);
+        _bright.setLimit(LIMITS[(uint8_t)target]);
+    }
+    else
+    {
+        _bright.setLimit(LIMITS[(uint8_t)target]);
+        _state = target;
+        if (_onStateChange)
+            _onStateChange(_state);
+
+        bool idle = target >= PowerState::Idle;
+        if (_idleMode != idle)
+        {
+            _tft.writecommand(CMD_IDMON);
+            _idleMode = true;
+        }
+        if (target == PowerState::Sleep && !_asleep)
+        {
+            _tft.writecommand(CMD_SLPIN);
+            _asleep = true;
+        }
+    }
+
+    LOG.log("Display %s", stateName(_state));
+}
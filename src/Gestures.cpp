@@ -0,0 +1,186 @@
+#include "Gestures.h"
+#include <algorithm>
+
+using namespace GestureConfig;
+
+// Constructor
+Gestures::Gestures()
+    : _timings{DEFAULT_DOUBLE_CLICK_MS, DEFAULT_LONG_PRESS_MS, DEFAULT_REPEAT_MS, DEFAULT_CHORD_MS},
+      _doubleMask(0), _queue(NULL), _mtx(NULL)
+{
+    for (uint8_t i = 0; i < ButtonConfig::COUNT; i++)
+    {
+        _phase[i] = Phase::Idle;
+        _downMs[i] = _deadline[i] = 0;
+        _repeats[i] = 0;
+        _timerArgs[i] = {this, i};
+        _timers[i] = NULL;
+    }
+}
+
+void Gestures::begin()
+{
+    _mtx = xSemaphoreCreateMutex();
+    _queue = xQueueCreate(QUEUE_LENGTH, sizeof(Gesture));
+    if (!_mtx || !_queue)
+        LOG.log("Warning! Gestures initialization failed.");
+
+    for (uint8_t i = 0; i < ButtonConfig::COUNT; i++)
+    {
+        _timers[i] = xTimerCreate("Gesture", 1, pdFALSE, &_timerArgs[i], _onTimer);
+        if (!_timers[i])
+            LOG.log("Warning! Gesture timer creation failed.");
+    }
+}
+
+// Per-button state machine, chords are checked across buttons on each press
+void Gestures::feed(const ButtonEvent &ev)
+{
+    uint8_t b = ev.button;
+    if (b >= ButtonConfig::COUNT)
+        return;
+
+    xSemaphoreTake(_mtx, portMAX_DELAY);
+    if (ev.down)
+    {
+        // Chord: another button went down just before this one and is still undecided
+        uint8_t chord = 0;
+        for (uint8_t i = 0; i < ButtonConfig::COUNT; i++)
+            if (i != b && _phase[i] == Phase::Down && ev.ms - _downMs[i] <= _timings.chordMs)
+                chord |= 1 << i;
+
+        if (chord)
+        {
+            chord |= 1 << b;
+            for (uint8_t i = 0; i < ButtonConfig::COUNT; i++)
+            {
+                if (chord & (1 << i))
+                {
+                    _disarm(i);
+                    _phase[i] = Phase::Consumed;
+                }
+            }
+            _emit(GestureType::Chord, chord);
+        }
+        else if (_phase[b] == Phase::Up)
+        {
+            _disarm(b);
+            _phase[b] = Phase::Consumed;
+            _emit(GestureType::DoubleClick, 1 << b);
+        }
+        else
+        {
+            _phase[b] = Phase::Down;
+            _downMs[b] = ev.ms;
+            _repeats[b] = 0;
+            _arm(b, _timings.longPressMs);
+        }
+    }
+    else
+    {
+        switch (_phase[b])
+        {
+        case Phase::Down:
+            if (_doubleMask & (1 << b))
+            {
+                _phase[b] = Phase::Up;
+                _arm(b, _timings.doubleClickMs);
+            }
+            else
+            {
+                _disarm(b);
+                _phase[b] = Phase::Idle;
+                _emit(GestureType::Click, 1 << b);
+            }
+            break;
+        case Phase::Long:
+        case Phase::Consumed:
+            _disarm(b);
+            _phase[b] = Phase::Idle;
+            break;
+        default: // Release of a press that was never fed (e.g. swallowed by a display wake)
+            break;
+        }
+    }
+    xSemaphoreGive(_mtx);
+}
+
+bool Gestures::next(Gesture &g)
+{
+    return _queue && xQueueReceive(_queue, &g, 0) == pdTRUE;
+}
+
+void Gestures::setTimings(const GestureTimings &timings)
+{
+    xSemaphoreTake(_mtx, portMAX_DELAY);
+    _timings = timings;
+    xSemaphoreGive(_mtx);
+}
+
+GestureTimings Gestures::getTimings() const
+{
+    return _timings;
+}
+
+void Gestures::setDoubleClickMask(uint8_t mask)
+{
+    xSemaphoreTake(_mtx, portMAX_DELAY);
+    _doubleMask = mask;
+    xSemaphoreGive(_mtx);
+}
+
+//==================== Private helpers ====================
+
+void Gestures::_arm(uint8_t button, uint32_t ms)
+{
+    _deadline[button] = millis() + ms;
+    xTimerChangePeriod(_timers[button], std::max<TickType_t>(1, pdMS_TO_TICKS(ms)), 0); // Also starts it
+}
+
+void Gestures::_disarm(uint8_t button)
+{
+    xTimerStop(_timers[button], 0);
+}
+
+void Gestures::_emit(GestureType type, uint8_t buttons, uint16_t count)
+{
+    Gesture g = {type, buttons, count, (uint32_t)millis()};
+    xQueueSend(_queue, &g, 0); // Full queue drops the gesture
+}
+
+// Long press, auto-repeat and double click window timeouts (timer service task)
+void Gestures::_onTimer(TimerHandle_t timer)
+{
+    TimerArg *arg = static_cast<TimerArg *>(pvTimerGetTimerID(timer));
+    Gestures *self = arg->self;
+    uint8_t b = arg->button;
+
+    xSemaphoreTake(self->_mtx, portMAX_DELAY);
+
+    // Fired from an arm that has been replaced or cancelled since
+    if ((int32_t)(millis() - self->_deadline[b]) < -(int32_t)STALE_SLACK_MS)
+    {
+        xSemaphoreGive(self->_mtx);
+        return;
+    }
+
+    switch (self->_phase[b])
+    {
+    case Phase::Down:
+        self->_phase[b] = Phase::Long;
+        self->_emit(GestureType::LongPress, 1 << b);
+        self->_arm(b, self->_timings.repeatMs);
+        break;
+    case Phase::Long:
+        self->_emit(GestureType::Repeat, 1 << b, ++self->_repeats[b]);
+        self->_arm(b, self->_timings.repeatMs);
+        break;
+    case Phase::Up:
+        self->_phase[b] = Phase::Idle;
+        self->_emit(GestureType::Click, 1 << b);
+        break;
+    default:
+        break;
+    }
+    xSemaphoreGive(self->_mtx);
+}
@@ -0,0 +1,166 @@
+#include "GlyphCache.h"
+
+using namespace GlyphCacheConfig;
+
+// Constructor
+GlyphCache::GlyphCache(TFT_eSPI &tft)
+    : _tft(tft), _bits(), _offset(), _width(), _height(0), _bytes(0), _ready(false), _font(0), _size(0), _fg(0), _bg(0)
+{
+}
+
+bool GlyphCache::build(uint8_t font, uint8_t size, uint16_t fg, uint16_t bg)
+{
+    // Font 0 until the first build, a failed build isn't retried for the same settings
+    if (font == _font && size == _size && fg == _fg && bg == _bg)
+        return _ready;
+
+    _ready = false;
+    _font = font;
+    _size = size;
+    _fg = fg;
+    _bg = bg;
+
+    // Same cell widths as the time layout: digits as wide as "8", blank as wide as ":"
+    _tft.setTextSize(size);
+    int16_t digitW = _tft.textWidth("8", font);
+    int16_t colonW = _tft.textWidth(":", font);
+    _height = _tft.fontHeight(font);
+    _tft.setTextSize(1);
+
+    _bytes = 0;
+    for (uint8_t i = 0; i < NUM_GLYPHS; i++)
+    {
+        _width[i] = GLYPHS[i] >= '0' && GLYPHS[i] <= '9' ? digitW : colonW;
+        _offset[i] = _bytes;
+        _bytes += ((_width[i] + 7) / 8) * _height;
+    }
+    if (_bytes > MAX_BYTES)
+        return false;
+
+    // One scratch sprite as large as a digit, rasterized in colour and read back as bits
+    TFT_eSprite scratch(&_tft);
+    if (!scratch.createSprite(digitW, _height))
+        return false;
+    for (uint8_t i = 0; i < NUM_GLYPHS; i++)
+        _render(i, scratch);
+    scratch.deleteSprite();
+
+    _ready = true;
+    return true;
+}
+
+bool GlyphCache::ready() const
+{
+    return _ready;
+}
+
+int16_t GlyphCache::width(char c) const
+{
+    int8_t i = _index(c);
+    return i < 0 ? 0 : _width[i];
+}
+
+int16_t GlyphCache::height() const
+{
+    return _height;
+}
+
+size_t GlyphCache::bytes() const
+{
+    return _ready ? _bytes : 0;
+}
+
+// Runs continue across rows, the address window wraps them
+void GlyphCache::blit(int16_t x, int16_t y, char c)
+{
+    int8_t i = _index(c);
+    if (!_ready || i < 0)
+        return;
+
+    int16_t w = _width[i];
+    uint16_t stride = (w + 7) / 8;
+    const uint8_t *bits = _bits + _offset[i];
+
+    _tft.setWindow(x, y, x + w - 1, y + _height - 1);
+    bool ink = false;
+    uint32_t run = 0;
+    for (int16_t row = 0; row < _height; row++, bits += stride)
+    {
+        for (int16_t col = 0; col < w; col++)
+        {
+            bool px = bits[col >> 3] & (0x80 >> (col & 7));
+            if (px != ink && run)
+            {
+                _tft.pushBlock(ink ? _fg : _bg, run);
+                run = 0;
+            }
+            ink = px;
+            run++;
+        }
+    }
+    if (run)
+        _tft.pushBlock(ink ? _fg : _bg, run);
+}
+
+void GlyphCache::blit(TFT_eSprite &spr, int16_t x, int16_t y, char c)
+{
+    int8_t i = _index(c);
+    uint16_t *buf = (uint16_t *)spr.getPointer();
+    if (!_ready || i < 0 || !buf)
+        return;
+
+    // Sprite buffers hold colours byte swapped, in panel order
+    uint16_t fg = (_fg >> 8) | (_fg << 8);
+    uint16_t bg = (_bg >> 8) | (_bg << 8);
+
+    int16_t w = _width[i];
+    uint16_t stride = (w + 7) / 8;
+    int16_t sw = spr.width();
+    int16_t sh = spr.height();
+    for (int16_t row = 0; row < _height; row++)
+    {
+        int16_t sy = y + row;
+        if (sy < 0 || sy >= sh)
+            continue;
+        const uint8_t *bits = _bits + _offset[i] + row * stride;
+        uint16_t *out = buf + sy * sw;
+        for (int16_t col = 0; col < w; col++)
+        {
+            int16_t sx = x + col;
+            if (sx >= 0 && sx < sw)
+                out[sx] = bits[col >> 3] & (0x80 >> (col & 7)) ? fg : bg;
+        }
+    }
+}
+
+//==================== Private helpers ====================
+
+int8_t GlyphCache::_index(char c) const
+{
+    for (uint8_t i = 0; i < NUM_GLYPHS; i++)
+        if (GLYPHS[i] == c)
+            return i;
+    return -1;
+}
+
+void GlyphCache::_render(uint8_t idx, TFT_eSprite &scratch)
+{
+    scratch.fillSprite(TFT_BLACK);
+    if (GLYPHS[idx] != ' ')
+    {
+        char glyph[2] = {GLYPHS[idx], '\0'};
+        scratch.setTextColor(TFT_WHITE);
+        scratch.setTextSize(_size);
+        scratch.setTextDatum(TL_DATUM);
+        scratch.drawString(glyph, 0, 0, _font);
+    }
+
+    int16_t w = _width[idx];
+    uint16_t stride = (w + 7) / 8;
+    uint8_t *bits = _bits + _offset[idx];
+    memset(bits, 0, stride * _height);
+    for (int16_t row = 0; row < _height; row++)
+        for (int16_t col = 0; col < w; col++)
+            if (scratch.readPixel(col, row) != TFT_BLACK)
+                bits[row * stride + (col >> 3)] |= 0x80 >> (col & 7);
+}
@@ -0,0 +1,164 @@
+#include "Playlist.h"
+#include <Preferences.h>
+#include <algorithm>
+#include <math.h>
+
+using namespace PlaylistConfig;
+
+// Constructor
+Playlist::Playlist()
+    : _id(0), _bound(false), _state{0, 0, 0, 0, {0}}
+{
+    memset(_weights, DEFAULT_WEIGHT, sizeof(_weights));
+}
+
+void Playlist::begin(uint8_t id, uint8_t trackCount)
+{
+    _id = id;
+    _bound = true;
+
+    if (!_load() || _state.count != trackCount)
+    {
+        _state.count = trackCount;
+        _state.last = 0;
+        _shuffle();
+        _save();
+    }
+}
+
+bool Playlist::isBound(uint8_t trackCount) const
+{
+    return _bound && _state.count == trackCount;
+}
+
+uint8_t Playlist::next()
+{
+    if (_state.cursor >= _state.length)
+        _shuffle();
+    if (_state.length == 0)
+        return 0;
+
+    _state.last = _state.order[_state.cursor++];
+    _save();
+    return _state.last;
+}
+
+void Playlist::reshuffle()
+{
+    _shuffle();
+    _save();
+}
+
+// Changes how a track is favored. Applies from the next cycle.
+bool Playlist::setWeight(uint8_t track, uint8_t weight)
+{
+    if (track < 1 || track > std::min(_state.count, MAX_TRACKS) || weight > MAX_WEIGHT)
+        return false;
+
+    _weights[track - 1] = weight;
+    _saveWeights();
+    return true;
+}
+
+uint8_t Playlist::getWeight(uint8_t track) const
+{
+    if (track < 1 || track > MAX_TRACKS)
+        return 0;
+    return _weights[track - 1];
+}
+
+uint8_t Playlist::remaining() const
+{
+    return _state.length - std::min(_state.cursor, _state.length);
+}
+
+uint8_t Playlist::length() const
+{
+    return _state.length;
+}
+
+//==================== Private helpers ====================
+
+// Builds a new cycle: Fisher-Yates when all weights are equal, otherwise a weighted
+// shuffle (Efraimidis-Spirakis keys, heavier tracks tend to come first)
+void Playlist::_shuffle()
+{
+    uint8_t n = std::min(_state.count, MAX_TRACKS);
+    bool weighted = false;
+    _state.length = 0;
+    for (uint8_t i = 0; i < n; i++)
+    {
+        if (_weights[i] == 0)
+            continue;
+        if (_weights[i] != DEFAULT_WEIGHT)
+            weighted = true;
+        _state.order[_state.length++] = i + 1;
+    }
+    _state.cursor = 0;
+
+    uint8_t len = _state.length;
+    if (!weighted)
+    {
+        for (uint8_t i = len; i > 1; i--)
+            std::swap(_state.order[i - 1], _state.order[random(i)]);
+    }
+    else
+    {
+        // key = u^(1/w), sorted descending. Compared as log(u)/w to avoid pow().
+        float keys[MAX_TRACKS];
+        for (uint8_t i = 0; i < len; i++)
+        {
+            float u = (random(1, 0x10000)) / 65536.0f;
+            keys[_state.order[i] - 1] = logf(u) / _weights[_state.order[i] - 1];
+        }
+        std::sort(_state.order, _state.order + len,
+                  [&keys](uint8_t a, uint8_t b)
+                  { return keys[a - 1] > keys[b - 1]; });
+    }
+
+    // The track that ended the last cycle shouldn't also start this one
+    if (len > 1 && _state.order[0] == _state.last)
+        std::swap(_state.order[0], _state.order[1 + random(len - 1)]);
+}
+
+void Playlist::_save()
+{
+    char key[4];
+    snprintf(key, sizeof(key), "o%u", _id);
+
+    Preferences prefs;
+    prefs.begin("playlist", false);
+    prefs.putBytes(key, &_state, sizeof(_state));
+    prefs.end();
+}
+
+void Playlist::_saveWeights()
+{
+    char key[4];
+    snprintf(key, sizeof(key), "w%u", _id);
+
+    Preferences prefs;
+    prefs.begin("playlist", false);
+    prefs.putBytes(key, _weights, sizeof(_weights));
+    prefs.end();
+}
+
+// Loads saved order and weights, returns false if no valid order was saved
+bool Playlist::_load()
+{
+    char orderKey[4], weightKey[4];
+    snprintf(orderKey, sizeof(orderKey), "o%u", _id);
+    snprintf(weightKey, sizeof(weightKey), "w%u", _id);
+
+    Preferences prefs;
+    prefs.begin("playlist", true);
+    if (prefs.getBytesLength(weightKey) == sizeof(_weights))
+        prefs.getBytes(weightKey, _weights, sizeof(_weights));
+
+    bool ok = prefs.getBytesLength(orderKey) == sizeof(_state);
+    if (ok)
+        prefs.getBytes(orderKey, &_state, sizeof(_state));
+    prefs.end();
+
+    return ok && _state.length <= MAX_TRACKS;
+}
@@ -1,51 +1,178 @@
 #include "RFIDHandler.h"
-#include "Config.h"
+#include "Log.h"
+#include "Settings.h"
+
+using namespace RFIDConfig;
 
 // Constructor
-RFIDHandler::RFIDHandler(MFRC522 &rfid)
-    : _rfid(rfid)
+RFIDHandler::RFIDHandler(MFRC522 &rfid, SpiDevice &spi, uint8_t irqPin)
+    : _rfid(rfid), _spi(spi), _irqPin(irqPin), _mode(RFIDMode::Poll), _irq(false), _lastKick(0),
+      _active(true), _poweredDown(false), _activatePending(false), _activateAt(0), _uid()
 {
 }
 
+void RFIDHandler::begin()
+{
+    SpiDevice::Lock bus(_spi);
+    pinMode(_irqPin, INPUT);
+    _rfid.PCD_WriteRegister(MFRC522::DivIEnReg, DIV_IEN_PUSH_PULL);
+    attachInterruptArg(digitalPinToInterrupt(_irqPin), _onIRQ, this, FALLING);
+
+    // Self-test: a REQA with nothing in the field ends in the reader's timeout interrupt
+    _rfid.PCD_WriteRegister(MFRC522::ComIEnReg, COM_IEN_TIMER);
+    _irq = false;
+    _kick();
+    delay(IRQ_TEST_MS);
+
+    _rfid.PCD_WriteRegister(MFRC522::ComIEnReg, COM_IEN_RX);
+    _rfid.PCD_WriteRegister(MFRC522::ComIrqReg, COM_IRQ_CLEAR);
+    if (_irq)
+    {
+        _mode = RFIDMode::Irq;
+        _irq = false;
+    }
+    else
+    {
+        _mode = RFIDMode::Poll;
+        detachInterrupt(digitalPinToInterrupt(_irqPin));
+        LOG.log("Warning: RFID IRQ line not responding, polling every %d ms.", SETTINGS.get(Setting::RfidPollMs));
+    }
+}
+
 // Main RFID card checking function, returns void
 // and instead passes UID through callbacks
 void RFIDHandler::poll()
 {
-    if (!_rfid.PICC_IsNewCardPresent() ||
-        !_rfid.PICC_ReadCardSerial())
+    bool found;
     {
-        return;
+        SpiDevice::Lock bus(_spi);
+        found = _check(millis());
     }
 
-    char uid[64];
-    getCardUID(uid);
+    // Outside the lock, the callback may redraw the screen
+    if (found && _uid.size && _onRFIDEvent)
+        _onRFIDEvent(_uid.uidByte, _uid.size);
+}
 
-    _rfid.PICC_HaltA();
-    _rfid.PCD_StopCrypto1();
+RFIDMode RFIDHandler::getMode() const
+{
+    return _mode;
+}
+
+// Called from whichever task changed the alarms, the bus lock also serializes it with _check()
+void RFIDHandler::setAlarmState(bool ringing, bool scheduled, uint32_t msUntilAlarm)
+{
+    SpiDevice::Lock bus(_spi);
+    if (ringing || (scheduled && msUntilAlarm <= ACTIVE_LEAD_MS))
+    {
+        _activatePending = false;
+        _setActive(true);
+        return;
+    }
+
+    _setActive(false);
+    _activatePending = scheduled;
+    _activateAt = millis() + msUntilAlarm - ACTIVE_LEAD_MS;
+}
 
-    if (_onRFIDEvent)
-        _onRFIDEvent(uid);
+bool RFIDHandler::isActive() const
+{
+    return _active;
 }
 
-// Get card UID as formatted buffer
-void RFIDHandler::getCardUID(char out[64])
+//==================== Private helpers ====================
+
+// Switches rate, powering the reader down or up when the idle rate is 0
+void RFIDHandler::_setActive(bool active)
 {
-    byte uidLen = _rfid.uid.size;
-    if(uidLen == 0 || uidLen > 10) {
-        out[0] = '\0';
+    SpiDevice::Lock bus(_spi);
+    _active = active;
+    bool powerDown = !active && SETTINGS.get(Setting::RfidIdleMs) == 0;
+    if (powerDown == _poweredDown)
         return;
+
+    if (powerDown)
+        _rfid.PCD_SoftPowerDown();
+    else
+        _rfid.PCD_SoftPowerUp(); // Registers (IRQ setup) are kept through power-down
+    _poweredDown = powerDown;
+    _irq = false;
+    _lastKick = 0; // Check right away after power-up
+}
+
+// One poll step with the bus held, true if a card was read into _uid
+bool RFIDHandler::_check(unsigned long now)
+{
+    // Alarm coming up
+    if (_activatePending && (long)(now - _activateAt) >= 0)
+    {
+        _activatePending = false;
+        _setActive(true);
     }
+    if (_poweredDown)
+        return false;
 
-    char* ptr = out;
-    size_t remaining = 64;
+    if (_mode == RFIDMode::Irq)
+    {
+        // A card answered the last REQA
+        if (_irq)
+        {
+            _irq = false;
+            _rfid.PCD_WriteRegister(MFRC522::ComIrqReg, COM_IRQ_CLEAR);
+            bool read = _rfid.PICC_ReadCardSerial();
+            if (read)
+                _readCard();
+            _irq = false; // Our own exchange raised it again
+            _lastKick = now;
+            return read;
+        }
+        else if (now - _lastKick >= (_active ? KICK_PERIOD_MS : (unsigned long)SETTINGS.get(Setting::RfidIdleMs)))
+        {
+            _lastKick = now;
+            _kick();
+        }
+        return false;
+    }
+
+    // Polling fallback
+    if (now - _lastKick < (unsigned long)SETTINGS.get(_active ? Setting::RfidPollMs : Setting::RfidIdleMs))
+        return false;
+    _lastKick = now;
 
-    for(byte i = 0; i < uidLen; i++) {
-        int written = snprintf(ptr, remaining, "%02X", _rfid.uid.uidByte[i]);
-        if(written < 0 || written >= remaining)
-            break;
-        ptr += written;
-        remaining -= written;
+    if (!_rfid.PICC_IsNewCardPresent() ||
+        !_rfid.PICC_ReadCardSerial())
+    {
+        return false;
     }
+    _readCard();
+    return true;
+}
+
+// Starts a REQA transceive and returns. A card answer raises RxIRq (the IRQ line),
+// no answer just times out inside the reader.
+void RFIDHandler::_kick()
+{
+    _rfid.PCD_WriteRegister(MFRC522::CommandReg, MFRC522::PCD_Idle);
+    _rfid.PCD_WriteRegister(MFRC522::ComIrqReg, COM_IRQ_CLEAR);
+    _rfid.PCD_WriteRegister(MFRC522::FIFOLevelReg, FIFO_FLUSH);
+    _rfid.PCD_WriteRegister(MFRC522::FIFODataReg, MFRC522::PICC_CMD_REQA);
+    _rfid.PCD_WriteRegister(MFRC522::CommandReg, MFRC522::PCD_Transceive);
+    _rfid.PCD_WriteRegister(MFRC522::BitFramingReg, BIT_FRAMING_START);
+}
+
+// Selected card: keep its UID and halt it so it doesn't answer again while it stays in the field
+void RFIDHandler::_readCard()
+{
+    _uid = _rfid.uid;
+    if (_uid.size > sizeof(_uid.uidByte))
+        _uid.size = 0;
 
-    *ptr = '\0';
-}
\ No newline at end of file
+    _rfid.PICC_HaltA();
+    _rfid.PCD_StopCrypto1();
+}
+
+// RC522 IRQ line
+void IRAM_ATTR RFIDHandler::_onIRQ(void *arg)
+{
+    static_cast<RFIDHandler *>(arg)->_irq = true;
+}
@@ -0,0 +1,208 @@
+#include "Settings.h"
+#include "AlarmSystem.h"
+#include "BrightnessController.h"
+#include "Config.h"
+#include "DisplayPower.h"
+#include "Gestures.h"
+#include "RFIDHandler.h"
+
+using namespace SettingsConfig;
+
+// Setting definitions, in enum Setting order. Names double as NVS keys (max 15 chars).
+struct SettingDef
+{
+    const char *name;
+    SettingType type;
+    int32_t min;
+    int32_t max;
+    int32_t def;
+};
+
+static const SettingDef DEFS[] = {
+    {"wifi_persist", SettingType::Bool, 0, 1, 0},
+    {"volume", SettingType::U8, 0, 30, PLAYER_VOLUME},
+    {"ramp_min", SettingType::U8, 0, AlarmConfig::MAX_WAKE_RAMP_MIN, AlarmConfig::DEFAULT_WAKE_RAMP_MIN},
+    {"ramp_sync", SettingType::Bool, 0, 1, 0},
+    {"amb_rise_ms", SettingType::U16, 100, 60000, BrightnessConfig::DEFAULT_RISE_TAU_MS},
+    {"amb_fall_ms", SettingType::U16, 100, 60000, BrightnessConfig::DEFAULT_FALL_TAU_MS},
+    {"dim_after_s", SettingType::U16, 5, 3600, DisplayPowerConfig::DEFAULT_DIM_AFTER_S},
+    {"night_start", SettingType::U16, 0, 1439, DisplayPowerConfig::DEFAULT_NIGHT_START},
+    {"night_end", SettingType::U16, 0, 1439, DisplayPowerConfig::DEFAULT_NIGHT_END},
+    {"long_press_ms", SettingType::U16, 200, 3000, GestureConfig::DEFAULT_LONG_PRESS_MS},
+    {"dbl_click_ms", SettingType::U16, 100, 1000, GestureConfig::DEFAULT_DOUBLE_CLICK_MS},
+    {"rfid_poll_ms", SettingType::U16, 20, 5000, RFIDConfig::DEFAULT_POLL_MS},
+    {"rfid_idle_ms", SettingType::U16, 0, 60000, RFIDConfig::DEFAULT_IDLE_MS},
+};
+static_assert(sizeof(DEFS) / sizeof(DEFS[0]) == (size_t)Setting::Count, "Settings table must match enum Setting");
+
+// Constructor
+Settings::Settings() : _dirty(0), _lastChange(0), _mtx(NULL)
+{
+    for (uint8_t i = 0; i < COUNT; i++)
+        _values[i] = DEFS[i].def;
+}
+
+void Settings::begin()
+{
+    _mtx = xSemaphoreCreateMutex();
+    if (!_mtx)
+        Serial.println("Warning: Settings mutex initialization failed.");
+
+    _prefs.begin("settings", true);
+    uint16_t version = _prefs.getUShort("schema", 0);
+    for (uint8_t i = 0; i < COUNT; i++)
+    {
+        const SettingDef &d = DEFS[i];
+        int32_t v;
+        switch (d.type)
+        {
+        case SettingType::Bool:
+            v = _prefs.getBool(d.name, d.def);
+            break;
+        case SettingType::U8:
+            v = _prefs.getUChar(d.name, d.def);
+            break;
+        case SettingType::U16:
+            v = _prefs.getUShort(d.name, d.def);
+            break;
+        case SettingType::I32:
+            v = _prefs.getInt(d.name, d.def);
+            break;
+        default:
+            v = (int32_t)_prefs.getUInt(d.name, d.def);
+            break;
+        }
+        _values[i] = (v < d.min || v > d.max) ? d.def : v;
+    }
+    _prefs.end();
+
+    if (version < SCHEMA_VERSION)
+    {
+        _migrate(version);
+        flush();
+    }
+}
+
+// Flushes once changes have been quiet for FLUSH_DELAY_MS
+void Settings::run()
+{
+    if (_dirty && millis() - _lastChange >= FLUSH_DELAY_MS)
+        flush();
+}
+
+// Writes all dirty settings (and the schema version) in one NVS session
+void Settings::flush()
+{
+    xSemaphoreTake(_mtx, portMAX_DELAY);
+    _prefs.begin("settings", false);
+    for (uint8_t i = 0; i < COUNT; i++)
+        if (_dirty & (1UL << i))
+            _write(i);
+    _prefs.putUShort("schema", SCHEMA_VERSION);
+    _prefs.end();
+    _dirty = 0;
+    xSemaphoreGive(_mtx);
+}
+
+int32_t Settings::get(Setting id) const
+{
+    xSemaphoreTake(_mtx, portMAX_DELAY);
+    int32_t v = _values[(uint8_t)id];
+    xSemaphoreGive(_mtx);
+    return v;
+}
+
+bool Settings::set(Setting id, int32_t value)
+{
+    uint8_t i = (uint8_t)id;
+    if (i >= COUNT || value < DEFS[i].min || value > DEFS[i].max)
+        return false;
+
+    xSemaphoreTake(_mtx, portMAX_DELAY);
+    bool changed = _values[i] != value;
+    if (changed)
+    {
+        _values[i] = value;
+        _dirty |= 1UL << i;
+        _lastChange = millis();
+    }
+    xSemaphoreGive(_mtx);
+
+    // Change callback
+    if (changed && _onChange[i])
+        _onChange[i](value);
+    return true;
+}
+
+void Settings::reset(Setting id)
+{
+    set(id, DEFS[(uint8_t)id].def);
+}
+
+bool Settings::find(const char *name, Setting &id) const
+{
+    for (uint8_t i = 0; i < COUNT; i++)
+    {
+        if (strcmp(name, DEFS[i].name) == 0)
+        {
+            id = (Setting)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char *Settings::name(Setting id) const
+{
+    return DEFS[(uint8_t)id].name;
+}
+
+SettingType Settings::type(Setting id) const
+{
+    return DEFS[(uint8_t)id].type;
+}
+
+void Settings::range(Setting id, int32_t &min, int32_t &max) const
+{
+    min = DEFS[(uint8_t)id].min;
+    max = DEFS[(uint8_t)id].max;
+}
+
+void Settings::onChange(Setting id, ChangeCallback cb)
+{
+    _onChange[(uint8_t)id] = cb;
+}
+
+//==================== Private helpers ====================
+
+// Upgrades stored data from an older schema, one version at a time. Marks imported values dirty.
+void Settings::_migrate(uint16_t from)
+{
+    // Schema 1 is the first stored layout, an unversioned namespace is just fresh
+    (void)from;
+}
+
+// Writes one setting to the open NVS namespace
+void Settings::_write(uint8_t idx)
+{
+    const SettingDef &d = DEFS[idx];
+    int32_t v = _values[idx];
+    switch (d.type)
+    {
+    case SettingType::Bool:
+        _prefs.putBool(d.name, v != 0);
+        break;
+    case SettingType::U8:
+        _prefs.putUChar(d.name, (uint8_t)v);
+        break;
+    case SettingType::U16:
+        _prefs.putUShort(d.name, (uint16_t)v);
+        break;
+    case SettingType::I32:
+        _prefs.putInt(d.name, v);
+        break;
+    default:
+        _prefs.putUInt(d.name, (uint32_t)v);
+        break;
+    }
+}
@@ -0,0 +1,135 @@
+#include "SpiBus.h"
+#include <esp_timer.h>
+
+using namespace SpiBusConfig;
+
+//==================== SpiDevice ====================
+
+// Constructor
+SpiDevice::SpiDevice(SpiBus &bus, const char *name, uint32_t hz, uint8_t mode)
+    : _bus(bus), _name(name), _hz(hz), _mode(mode), _operations(0), _busyUs(0), _waitUs(0), _since(0)
+{
+    _bus._add(this);
+}
+
+void SpiDevice::setBatch(BatchHook begin, BatchHook end)
+{
+    _batchBegin = begin;
+    _batchEnd = end;
+}
+
+SpiDevice::Lock::Lock(SpiDevice &dev)
+    : _dev(dev), _prev(dev._bus._acquire(dev))
+{
+}
+
+SpiDevice::Lock::~Lock()
+{
+    _dev._bus._release(_dev, _prev);
+}
+
+SpiDevice::Stats SpiDevice::getStats() const
+{
+    xSemaphoreTakeRecursive(_bus._mtx, portMAX_DELAY);
+    Stats s = {_operations, _busyUs, _waitUs};
+    if (_bus._current == this) // Include the running operation
+        s.busyUs += esp_timer_get_time() - _since;
+    xSemaphoreGiveRecursive(_bus._mtx);
+    return s;
+}
+
+//==================== SpiBus ====================
+
+// Constructor
+SpiBus::SpiBus()
+    : _devices(), _count(0), _current(NULL), _last(NULL), _reconfigs(0), _beginUs(0), _mtx(NULL)
+{
+}
+
+void SpiBus::begin()
+{
+    _mtx = xSemaphoreCreateRecursiveMutex();
+    if (!_mtx)
+        Serial.println("Warning: SpiBus mutex initialization failed.");
+    _beginUs = esp_timer_get_time();
+}
+
+uint8_t SpiBus::deviceCount() const
+{
+    return _count;
+}
+
+const SpiDevice *SpiBus::device(uint8_t idx) const
+{
+    return idx < _count ? _devices[idx] : NULL;
+}
+
+uint32_t SpiBus::getReconfigs() const
+{
+    return _reconfigs;
+}
+
+uint64_t SpiBus::uptimeUs() const
+{
+    return esp_timer_get_time() - _beginUs;
+}
+
+//==================== Private helpers ====================
+
+void SpiBus::_add(SpiDevice *dev)
+{
+    if (_count < MAX_DEVICES)
+        _devices[_count++] = dev;
+}
+
+// Takes the bus for a device, returns the device it takes over from in this task
+SpiDevice *SpiBus::_acquire(SpiDevice &dev)
+{
+    int64_t asked = esp_timer_get_time();
+    xSemaphoreTakeRecursive(_mtx, portMAX_DELAY);
+    int64_t now = esp_timer_get_time();
+
+    SpiDevice *prev = _current;
+    if (prev == &dev) // Nested lock of the same device
+        return prev;
+
+    if (prev)
+        _leave(prev, now);
+    else
+        dev._waitUs += now - asked; // Outermost lock, any wait was another task
+    _enter(&dev, now);
+    return prev;
+}
+
+void SpiBus::_release(SpiDevice &dev, SpiDevice *prev)
+{
+    if (prev != &dev)
+    {
+        int64_t now = esp_timer_get_time();
+        _leave(&dev, now);
+        if (prev)
+            _enter(prev, now);
+    }
+    xSemaphoreGiveRecursive(_mtx);
+}
+
+void SpiBus::_enter(SpiDevice *dev, int64_t now)
+{
+    if (_last && (_last->_hz != dev->_hz || _last->_mode != dev->_mode))
+        _reconfigs++;
+    _last = dev;
+    _current = dev;
+
+    dev->_operations++;
+    dev->_since = now;
+    if (dev->_batchBegin)
+        dev->_batchBegin();
+}
+
+void SpiBus::_leave(SpiDevice *dev, int64_t now)
+{
+    if (dev->_batchEnd)
+        dev->_batchEnd();
+    dev->_busyUs += now - dev->_since;
+    _current = NULL;
+}
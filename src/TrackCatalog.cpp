@@ -0,0 +1,231 @@
+#include "TrackCatalog.h"
+#include "Log.h"
+
+using namespace TrackConfig;
+
+// Constructor
+TrackCatalog::TrackCatalog(AudioPlayer &player)
+    : _player(player), _totalFiles(0), _folderCount(0), _counts{0}, _fromCache(false), _checked(0), _mtx(NULL)
+{
+}
+
+// Two cheap queries identify the card, per-folder counts are only queried when they change
+void TrackCatalog::begin()
+{
+    _mtx = xSemaphoreCreateMutex();
+    if (!_mtx)
+        LOG.log("Warning! TrackCatalog mutex initialization failed.");
+    _player.onQueryAnswer([this](AudioPlayer::Query q, uint8_t folder, int n)
+                          {
+                              if (q == AudioPlayer::Query::FolderFileCount)
+                                  _onFolderCount(folder, n);
+                          });
+
+    int files = _player.query(AudioPlayer::Query::FileCount);
+    int folders = _player.query(AudioPlayer::Query::FolderCount);
+    if (files < 0 || folders < 0)
+    {
+        LOG.log("Warning! Track catalog: no answer from player.");
+        return;
+    }
+
+    _fromCache = _load(_fingerprint(files, folders));
+    if (!_fromCache)
+        rescan();
+
+    LOG.log("Track catalog: %d files, %d folders%s", _totalFiles, _folderCount, _fromCache ? " (cached)" : "");
+}
+
+bool TrackCatalog::rescan()
+{
+    int files = _player.query(AudioPlayer::Query::FileCount);
+    int folders = _player.query(AudioPlayer::Query::FolderCount);
+    if (files < 0 || folders < 0)
+        return false;
+
+    _totalFiles = files;
+    _folderCount = std::min(folders, (int)MAX_CATEGORIES);
+    memset(_counts, 0, sizeof(_counts));
+    for (uint8_t f = 1; f <= _folderCount; f++)
+    {
+        int n = _player.query(AudioPlayer::Query::FolderFileCount, f);
+        _counts[f] = n > 0 ? std::min(n, 255) : 0;
+    }
+
+    _fromCache = false;
+    _checked = 0xFFFFFFFF; // All just queried
+    _save(_fingerprint(files, folders));
+    return true;
+}
+
+uint8_t TrackCatalog::categoryCount() const
+{
+    return _folderCount;
+}
+
+uint16_t TrackCatalog::trackCount(uint8_t category) const
+{
+    if (category == ALL)
+        return _totalFiles;
+    return category <= _folderCount ? _counts[category] : 0;
+}
+
+bool TrackCatalog::fromCache() const
+{
+    return _fromCache;
+}
+
+bool TrackCatalog::play(uint8_t category, uint16_t track, uint8_t mode)
+{
+    uint8_t folder = category;
+    uint16_t count = trackCount(category);
+    if (count == 0)
+    {
+        // Root-only card or missing folder
+        category = ALL;
+        count = _totalFiles;
+    }
+    if (count == 0)
+        return false;
+
+    if (track == 0 || track > count)
+    {
+        if (_mtx)
+            xSemaphoreTake(_mtx, portMAX_DELAY);
+        Playlist *pl = mode == SHUFFLE ? _playlist(category) : NULL;
+        track = pl ? pl->next() : random(1, count + 1);
+        if (_mtx)
+            xSemaphoreGive(_mtx);
+
+        if (track == 0)
+            return false; // Every track excluded by weight
+    }
+
+    bool ok = category == ALL ? _player.play(track) : _player.playFolder(category, track);
+
+    // Queued after the play command, so the sound never waits for the answer
+    _checkCount(folder);
+    return ok;
+}
+
+bool TrackCatalog::playlistInfo(uint8_t category, PlaylistInfo &out)
+{
+    if (_mtx)
+        xSemaphoreTake(_mtx, portMAX_DELAY);
+    Playlist *pl = _playlist(category);
+    if (pl)
+    {
+        out.remaining = pl->remaining();
+        out.length = pl->length();
+        out.count = trackCount(category);
+        for (uint8_t t = 1; t <= out.count; t++)
+            out.weights[t - 1] = pl->getWeight(t);
+    }
+    if (_mtx)
+        xSemaphoreGive(_mtx);
+    return pl != NULL;
+}
+
+bool TrackCatalog::reshuffle(uint8_t category)
+{
+    if (_mtx)
+        xSemaphoreTake(_mtx, portMAX_DELAY);
+    Playlist *pl = _playlist(category);
+    if (pl)
+        pl->reshuffle();
+    if (_mtx)
+        xSemaphoreGive(_mtx);
+    return pl != NULL;
+}
+
+bool TrackCatalog::setWeight(uint8_t category, uint8_t track, uint8_t weight)
+{
+    if (_mtx)
+        xSemaphoreTake(_mtx, portMAX_DELAY);
+    Playlist *pl = _playlist(category);
+    bool ok = pl && pl->setWeight(track, weight);
+    if (_mtx)
+        xSemaphoreGive(_mtx);
+    return ok;
+}
+
+//==================== Private helpers ====================
+
+// Loads a category's playlist on first use, and rebinds it when the card's count changed
+Playlist *TrackCatalog::_playlist(uint8_t category)
+{
+    uint16_t count = trackCount(category);
+    if (category > MAX_CATEGORIES || count == 0 || count > PlaylistConfig::MAX_TRACKS)
+        return NULL;
+
+    Playlist &pl = _playlists[category];
+    if (!pl.isBound(count))
+        pl.begin(category, count);
+    return &pl;
+}
+
+// Identifies a card by its file and folder totals
+uint32_t TrackCatalog::_fingerprint(int files, int folders)
+{
+    return ((uint32_t)files << 8) | (uint8_t)folders;
+}
+
+// Asks the audio task for a folder's count once per boot, _onFolderCount gets the answer
+void TrackCatalog::_checkCount(uint8_t folder)
+{
+    if (folder == ALL || folder > _folderCount)
+        return;
+
+    if (_mtx)
+        xSemaphoreTake(_mtx, portMAX_DELAY);
+    bool queued = _checked & (1UL << folder);
+    if (!queued && _player.queryAsync(AudioPlayer::Query::FolderFileCount, folder))
+        _checked |= 1UL << folder; // Not retried if the player doesn't answer
+    if (_mtx)
+        xSemaphoreGive(_mtx);
+}
+
+// Audio task: replaces a cached folder count (and its cache) if it changed
+void TrackCatalog::_onFolderCount(uint8_t folder, int n)
+{
+    if (n < 0 || folder == ALL || folder > MAX_CATEGORIES)
+        return; // No answer (often while playing), keep the cached count
+    uint8_t count = n > 0 ? std::min(n, 255) : 0;
+
+    if (_mtx)
+        xSemaphoreTake(_mtx, portMAX_DELAY);
+    bool changed = _counts[folder] != count;
+    if (changed)
+    {
+        _counts[folder] = count;
+        _save(_fingerprint(_totalFiles, _folderCount));
+    }
+    if (_mtx)
+        xSemaphoreGive(_mtx);
+
+    if (changed)
+        LOG.log("Track catalog: folder %d now has %d files", folder, count);
+}
+
+// Loads cached counts if they belong to the card with this fingerprint
+bool TrackCatalog::_load(uint32_t fingerprint)
+{
+    _prefs.begin("tracks", true);
+    bool ok = _prefs.getUInt("fp", 0) == fingerprint && _prefs.getBytesLength("counts") == sizeof(_counts);
+    if (ok)
+    {
+        _prefs.getBytes("counts", _counts, sizeof(_counts));
+        _totalFiles = fingerprint >> 8;
+        _folderCount = std::min<uint8_t>(fingerprint & 0xFF, MAX_CATEGORIES);
+    }
+    _prefs.end();
+    return ok;
+}
+
+void TrackCatalog::_save(uint32_t fingerprint)
+{
+    _prefs.begin("tracks", false);
+    _prefs.putUInt("fp", fingerprint);
+    _prefs.putBytes("counts", _counts, sizeof(_counts));
+    _prefs.end();
+}
@@ -1,20 +1,56 @@
 #include "UI.h"
+#include "Log.h"
+
+using namespace UIConfig;
 
 // Constructor
-UI::UI(TFT_eSPI &tft, Buttons &btn, Timekeeper &tk, NetworkManager &net) // TODO: consider removing network object access
-    : _tft(tft), _state(State::Boot), _btn(btn), _tk(tk), _net(net)
+UI::UI(TFT_eSPI &tft, SpiDevice &spi, Buttons &btn, Timekeeper &tk, NetworkManager &net) // TODO: consider removing network object access
+    : _tft(tft), _spi(spi), _state(State::Boot), _drawing(true), _lowPower(false), _btn(btn), _tk(tk), _net(net),
+      _weatherWidget(tft), _alarmWidget(tft), _dateWidget(tft), _statusWidget(tft), _timeWidget(tft),
+      _widgets{&_weatherWidget, &_alarmWidget, &_dateWidget, &_statusWidget, &_timeWidget}, _clearPending(true),
+      _bench(), _benchDone(NULL),
+      _bytesPushed(0), _dropped(0), _coalesced(0), _frames(0), _dma(false), _queue(NULL), _mailbox(), _task(NULL)
 {
 }
 
 // Init
 bool UI::begin()
 {
-    _tft.setRotation(1); // landscape orientation
-    _tft.fillScreen(Colors::BACKGROUND_COLOR);
-    _tft.setCursor(0, 5);
-    _tft.setTextColor(Colors::TEXT_COLOR);
-    _tft.setTextSize(1);
-    _tft.println("- Michael's totally wicked custom clock v0.52 -\n");
+    {
+        SpiDevice::Lock bus(_spi);
+        _tft.setRotation(1); // landscape orientation
+        _tft.fillScreen(Colors::BACKGROUND_COLOR);
+        _tft.setCursor(0, 5);
+        _tft.setTextColor(Colors::TEXT_COLOR);
+        _tft.setTextSize(1);
+        _tft.println("- Michael's totally wicked custom clock v0.52 -\n");
+    }
+
+    // Failed allocations fall back to drawing on the panel
+    bool ok = true;
+    for (Widget *w : _widgets)
+        ok &= w->begin();
+    if (!ok)
+        LOG.log("Warning: UI sprite allocation failed, drawing directly.");
+
+    // Sprite buffers are in panel byte order, DMA sends them as they are
+    _dma = _tft.initDMA();
+    if (!_dma)
+        LOG.log("Warning: TFT DMA unavailable, pushing sprites by CPU.");
+
+    _benchDone = xSemaphoreCreateBinary();
+    if (!_benchDone)
+        LOG.log("Warning: UI benchmark semaphore initialization failed.");
+
+    // Until the task runs, requests are handled by the caller
+    bool queues = (_queue = xQueueCreate(QUEUE_LENGTH, sizeof(DrawRequest))) != NULL;
+    for (QueueHandle_t &box : _mailbox)
+        queues &= (box = xQueueCreate(1, sizeof(DrawRequest))) != NULL;
+    if (!queues || xTaskCreatePinnedToCore(_taskEntry, "RenderTask", TASK_STACK, this, TASK_PRIORITY, &_task, TASK_CORE) != pdPASS)
+    {
+        _task = NULL;
+        LOG.log("Warning! UI render task creation failed, drawing on the caller.");
+    }
 
     return true;
 }
@@ -26,12 +62,10 @@ void UI::run()
     {
     case State::Boot: // As of right now, this should not be possible.
     {
-        DateTime time = _tk.time();
-        _tft.fillScreen(Colors::BACKGROUND_COLOR);
-        _tft.setTextSize(2);
-        _tft.setCursor(8, 8);
-        _tft.printf("Timestamp %02d:%02d:%02d %02d/%02d/%04d", time.hour(), time.minute(), time.second(), time.month(), time.day(), time.year());
-        drawCenteredString("How did we get here?", TFT_YELLOW, Colors::BACKGROUND_COLOR, 2);
+        DrawRequest req;
+        req.op = DrawOp::Lost;
+        req.unixtime = _tk.time().unixtime();
+        _post(req);
         break;
     }
 
@@ -40,11 +74,18 @@ void UI::run()
         if (_tk.tick()) // If time has changed
         {
             DateTime time = _tk.time();
-            if (_tk.secondTick()) // If second has changed
+            if (_tk.secondTick() && (!_lowPower || _tk.minuteTick())) // If second has changed (minute in idle mode)
             {
-                bool colon = (time.second() % 2 == 0); // true for even. false for odd
+                bool colon = _lowPower || (time.second() % 2 == 0); // true for even. false for odd
                 updateTimeDisplay(time, colon);
             }
+            if (_tk.secondTick() && _statusDataCb)
+            {
+                DrawRequest req;
+                req.op = DrawOp::Status;
+                req.status = _statusDataCb();
+                _post(req);
+            }
             /********** Unused **********
             if (_tk.minuteTick()) // If minute has changed
             {
@@ -58,7 +99,6 @@ void UI::run()
                 updateDateDisplay(time);
             }
         }
-        handleClockButtonIn();
         break;
     }
     case State::Settings:
@@ -106,51 +146,47 @@ State UI::getState() const
     return _state;
 }
 
-//==================== Boot State ====================
-
-// Displays status of given hardware component bools, returns overall status bool
-bool UI::displayStartupStatus(bool rtcOK, bool rtcLostPower, bool playerOK, bool rfidOK)
+// Follows display power state
+void UI::setPowerState(PowerState power)
 {
-    _tft.setTextSize(1);
-    _tft.setTextColor(Colors::TEXT_COLOR);
+    bool drawing = power < PowerState::BacklightOff;
+    bool wasDrawing = _drawing;
+    _drawing = drawing;
+    _lowPower = power >= PowerState::Idle;
 
-    _tft.println("----------------------------------------");
-    _tft.println("Board status:\n");
-
-    _tft.print("RTC ");
-    _tft.println(rtcOK ? "OK" : "FAIL");
-
-    if (rtcLostPower)
+    // Widgets kept their data while dark, the panel kept its contents: one frame catches up
+    if (drawing && !wasDrawing && _state == State::Clock)
     {
-        _tft.setTextColor(TFT_YELLOW);
-        _tft.println("RTC experienced a power loss since last boot.");
-        _tft.setTextColor(Colors::TEXT_COLOR);
+        DrawRequest req;
+        req.op = DrawOp::Repaint;
+        req.unixtime = _tk.time().unixtime();
+        _post(req);
     }
+    else if (_lowPower && _state == State::Clock)
+        updateTimeDisplay(_tk.time(), true); // Steady colon
+}
 
-    _tft.print("DFPlayer ");
-    _tft.println(playerOK ? "OK" : "FAIL");
+//==================== Boot State ====================
 
-    _tft.print("RFID ");
-    _tft.println(rfidOK ? "OK" : "FAIL");
+// Displays status of given hardware component bools, returns overall status bool
+bool UI::displayStartupStatus(bool rtcOK, bool rtcLostPower, bool playerOK, bool rfidOK)
+{
+    DrawRequest req;
+    req.op = DrawOp::Startup;
+    req.startup = {rtcOK, rtcLostPower, playerOK, rfidOK};
+    _post(req);
 
-    bool ok = false;
-    if (rtcOK && playerOK && rfidOK)
-    {
-        _tft.setTextColor(TFT_GREEN);
-        _tft.println("\nAll hardware components responding.");
-        _tft.setTextColor(Colors::TEXT_COLOR);
-        if (!rtcLostPower)
-            ok = true;
-    }
-    else
-    {
-        _tft.setTextColor(TFT_RED);
-        _tft.println("\nWarning: a hardware component is not responding.");
-        _tft.println("Clock functions may not work as intended.");
-        _tft.setTextColor(Colors::TEXT_COLOR);
-    }
-    _tft.println("\nSystem check complete.");
-    return ok;
+    return rtcOK && playerOK && rfidOK && !rtcLostPower;
+}
+
+void UI::print(const char *text, uint16_t color)
+{
+    DrawRequest req;
+    req.op = DrawOp::Print;
+    req.color = color;
+    strncpy(req.text, text, PRINT_LEN - 1);
+    req.text[PRINT_LEN - 1] = '\0';
+    _post(req);
 }
 
 //==================== Clock State ====================
@@ -158,133 +194,453 @@ bool UI::displayStartupStatus(bool rtcOK, bool rtcLostPower, bool playerOK, bool
 // restores main screen display state
 void UI::drawClockScreen(const DateTime &time, const WeatherData &weather)
 {
-    delay(100);
-    _tft.fillScreen(Colors::BACKGROUND_COLOR);
-    updateTimeDisplay(time);
-    updateDateDisplay(time);
-    updateWeatherDisplay(weather);
-    updateAlarmDisplay();
+    DrawRequest req;
+    req.op = DrawOp::Clock;
+    req.unixtime = time.unixtime();
+    req.weather = weather;
+    _post(req);
 }
 
 // Updates time display
 void UI::updateTimeDisplay(const DateTime &time, bool isColon)
 {
-    char buf[12];
-    if (isColon)
-        snprintf(buf, sizeof(buf), "%02d:%02d", time.hour(), time.minute());
-    else
-        snprintf(buf, sizeof(buf), "%02d %02d", time.hour(), time.minute());
-    drawCenteredString(buf, Colors::TEXT_COLOR, Colors::BACKGROUND_COLOR, 7, 2);
+    DrawRequest req;
+    req.op = DrawOp::Time;
+    req.unixtime = time.unixtime();
+    req.colon = isColon;
+    _post(req);
 }
 
 // Updates date display
 void UI::updateDateDisplay(const DateTime &time)
 {
-    _tft.setTextColor(Colors::TEXT_COLOR, Colors::BACKGROUND_COLOR);
-    _tft.setTextFont(1);
-    _tft.setTextSize(1);
-    _tft.setCursor(2, 16);
-    char buf[16];
-    snprintf(buf, sizeof(buf), "%02d/%02d/%04d", time.month(), time.day(), time.year());
-    _tft.print(buf);
+    DrawRequest req;
+    req.op = DrawOp::Date;
+    req.unixtime = time.unixtime();
+    _post(req);
 }
 
 // updates weather display
 void UI::updateWeatherDisplay(const WeatherData &weather)
 {
-    _tft.fillRect(0, 208, 120, 32, Colors::BACKGROUND_COLOR);
-    _tft.setTextColor(Colors::TEXT_COLOR, Colors::BACKGROUND_COLOR);
-    _tft.setTextFont(1);
+    DrawRequest req;
+    req.op = DrawOp::Weather;
+    req.weather = weather;
+    _post(req);
+}
 
-    if (!weather.valid)
-    {
-        _tft.setTextSize(1);
-        _tft.setCursor(2, 224);
-        _tft.println("Weather Unavailable");
+// updates alarm display
+void UI::updateAlarmDisplay()
+{
+    if (!_alarmDataCb)
         return;
-    }
+    DrawRequest req;
+    req.op = DrawOp::Alarm;
+    req.alarm = _alarmDataCb();
+    _post(req);
+}
 
-    int16_t x = 2;
-    int16_t y = 204;
+uint32_t UI::getBytesPushed() const
+{
+    return _bytesPushed;
+}
 
-    // current temp
-    _tft.setTextSize(2);
-    _tft.setCursor(x, y);
+uint32_t UI::getDroppedRequests() const
+{
+    return _dropped;
+}
 
-    char tempBuf[8];
-    snprintf(tempBuf, sizeof(tempBuf), "%d", (int)weather.temperature);
-    _tft.print(tempBuf);
+uint32_t UI::getCoalesced() const
+{
+    return _coalesced;
+}
 
-    // Measure printed temp width
-    int16_t tempWidth = _tft.textWidth(tempBuf);
+uint32_t UI::getFrames() const
+{
+    return _frames;
+}
 
-    // weather conditions and farenheit marker
-    _tft.setTextSize(1);
-    _tft.setCursor(x + tempWidth + 2, y + 6); // +6 aligns baselines nicely
+bool UI::usesDMA() const
+{
+    return _dma;
+}
+
+bool UI::benchmarkTime(uint16_t runs, TimeBenchmark &out)
+{
+    if (!_benchDone || runs == 0)
+        return false;
+    xSemaphoreTake(_benchDone, 0); // Result of an earlier run that timed out
+
+    DrawRequest req;
+    req.op = DrawOp::Bench;
+    req.runs = runs;
+    _post(req);
+
+    if (xSemaphoreTake(_benchDone, pdMS_TO_TICKS(BENCH_TIMEOUT_MS)) != pdTRUE)
+        return false;
+    out = _bench;
+    return true;
+}
+
+//==================== Helpers ====================
 
-    char buf[32];
-    snprintf(buf, sizeof(buf), "F | H%d | L%d", (int)weather.tempMax, (int)weather.tempMin);
-    _tft.print(buf);
+// Flashes screen with color for set duration.
+void UI::flashScreen(uint16_t flashColor, int flashDuration)
+{
+    if (!_drawing)
+        return;
+    DrawRequest req;
+    req.op = DrawOp::Animate;
+    req.anim = Animation::flash(SCREEN_EFFECT, {0, 0, (int16_t)_tft.width(), (int16_t)_tft.height()}, flashColor, flashDuration);
+    _post(req);
+}
+
+// Blends the whole screen from one color to another, then shows the clock again
+void UI::fadeScreen(uint16_t from, uint16_t to, int duration, Ease curve)
+{
+    if (!_drawing)
+        return;
+    DrawRequest req;
+    req.op = DrawOp::Animate;
+    req.anim = Animation::fade(SCREEN_EFFECT, {0, 0, (int16_t)_tft.width(), (int16_t)_tft.height()}, from, to, duration, curve);
+    _post(req);
+}
 
-    // hi/low temps
-    _tft.setCursor(2, 224);
-    _tft.println(weather.description);
+void UI::cancelEffects()
+{
+    DrawRequest req;
+    req.op = DrawOp::Cancel;
+    req.id = SCREEN_EFFECT;
+    _post(req);
 }
 
-// updates alarm display
-void UI::updateAlarmDisplay()
+//==================== Private helpers ====================
+
+// Hands a request to the render task without waiting. Data updates replace the one still
+// waiting in their mailbox, other requests are queued and dropped when the queue is full.
+void UI::_post(DrawRequest &req)
 {
-    // Get alarm data via callback
-    if (!_alarmDataCb)
+    if (!_task)
+    {
+        _apply(req);
         return;
-    AlarmDisplayData alarm = _alarmDataCb();
+    }
 
-    _tft.setTextColor(Colors::TEXT_COLOR, Colors::BACKGROUND_COLOR);
-    _tft.setTextFont(1);
-    _tft.setTextSize(1);
-    _tft.setTextDatum(BR_DATUM);
+    int8_t box = _mailboxFor(req.op);
+    if (box >= 0)
+    {
+        if (uxQueueMessagesWaiting(_mailbox[box]))
+            _coalesced++;
+        xQueueOverwrite(_mailbox[box], &req);
+    }
+    else if (xQueueSend(_queue, &req, 0) != pdTRUE)
+    {
+        _dropped++;
+        return;
+    }
+    xTaskNotifyGive(_task);
+}
+
+int8_t UI::_mailboxFor(DrawOp op)
+{
+    int8_t box = (int8_t)op - (int8_t)DrawOp::Time;
+    return box >= 0 && box < MAILBOXES ? box : -1;
+}
 
-    if (alarm.enabled)
+// Applies everything posted since the last frame, then renders one frame for all of it.
+// Ordered requests go first so the mailboxes' data lands on the screen they set up.
+void UI::_taskEntry(void *arg)
+{
+    UI *self = static_cast<UI *>(arg);
+    DrawRequest req;
+    while (true)
     {
-        char buf[32];
-        snprintf(buf, sizeof(buf), "Alarm: %02d:%02d %s",
-                 alarm.hour, alarm.minute,
-                 alarm.ringing ? "RINGING" : "SET");
-        _tft.drawString(buf, 314, 232);
+        // Wakes on new requests, and at the frame rate while an animation runs
+        ulTaskNotifyTake(pdTRUE, self->_anim.active() ? pdMS_TO_TICKS(FRAME_MS) : portMAX_DELAY);
+        while (xQueueReceive(self->_queue, &req, 0) == pdTRUE)
+            self->_apply(req);
+        for (QueueHandle_t box : self->_mailbox)
+            if (xQueueReceive(box, &req, 0) == pdTRUE)
+                self->_apply(req);
+        self->_renderFrame();
     }
+}
+
+// Clock screen requests only change widget data, boot screen requests draw right away
+void UI::_apply(const DrawRequest &req)
+{
+    switch (req.op)
+    {
+    case DrawOp::Clock:
+        // A ringing alarm keeps blinking through a screen reset
+        _anim.cancel(SCREEN_EFFECT);
+        _anim.cancel(WEATHER_SLIDE);
+        _clearPending = true;
+        _weatherWidget.set(req.weather);
+        // fall through
+    case DrawOp::Repaint:
+        _timeWidget.set(DateTime(req.unixtime).hour(), DateTime(req.unixtime).minute(), true);
+        _dateWidget.set(DateTime(req.unixtime));
+        break;
+    case DrawOp::Time:
+    {
+        DateTime time(req.unixtime);
+        _timeWidget.set(time.hour(), time.minute(), req.colon);
+        break;
+    }
+    case DrawOp::Date:
+        _dateWidget.set(DateTime(req.unixtime));
+        break;
+    case DrawOp::Weather:
+    {
+        bool wasDirty = _weatherWidget.isDirty();
+        _weatherWidget.set(req.weather);
+        if (!wasDirty && _weatherWidget.isDirty()) // New weather shown
+            _anim.start(Animation::slide(WEATHER_SLIDE, &_weatherWidget, -_weatherWidget.bounds().w, 0, SLIDE_MS, Ease::Out), millis());
+        break;
+    }
+    case DrawOp::Alarm:
+        _alarmWidget.set(req.alarm);
+        if (!req.alarm.ringing)
+            _anim.cancel(ALARM_BLINK);
+        else if (!_anim.isRunning(ALARM_BLINK))
+            _anim.start(Animation::blink(ALARM_BLINK, &_alarmWidget, ALARM_BLINK_MS), millis());
+        break;
+    case DrawOp::Status:
+        _statusWidget.set(req.status);
+        break;
+    case DrawOp::Animate:
+        if (!_anim.start(req.anim, millis()))
+            _dropped++;
+        break;
+    case DrawOp::Cancel:
+        _anim.cancel(req.id);
+        break;
+    case DrawOp::Bench:
+        _runBenchmark(req.runs);
+        break;
+    case DrawOp::Lost:
+    {
+        SpiDevice::Lock bus(_spi);
+        _drawLost(DateTime(req.unixtime));
+        _clearPending = true;
+        break;
+    }
+    case DrawOp::Startup:
+    {
+        SpiDevice::Lock bus(_spi);
+        _drawStartupStatus(req.startup);
+        break;
+    }
+    case DrawOp::Print:
+    {
+        SpiDevice::Lock bus(_spi);
+        _tft.setTextColor(req.color);
+        _tft.print(req.text);
+        _tft.setTextColor(Colors::TEXT_COLOR);
+        break;
+    }
+    }
+
+    if (!_task) // No render task, draw on the caller
+        _renderFrame();
+}
+
+// Repaints the damaged areas of the clock screen
+void UI::_renderFrame()
+{
+    _anim.step(millis()); // Effects run out while dark too
+    if (!_drawing || _state != State::Clock)
+        return; // Widgets stay dirty until the panel shows them again
+
+    Region areas[MAX_DAMAGE];
+    Widget *owners[MAX_DAMAGE];
+    uint8_t n = 0;
+
+    if (_clearPending)
+    {
+        for (Widget *w : _widgets)
+            w->invalidate();
+        _anim.invalidate();
+    }
+    for (Widget *w : _widgets)
+    {
+        uint8_t k = w->damage(areas + n, MAX_DAMAGE - n);
+        for (uint8_t i = 0; i < k; i++)
+            owners[n + i] = w;
+        n += k;
+    }
+    uint8_t k = _anim.damage(areas + n, MAX_DAMAGE - n); // Overlays have no canvas
+    for (uint8_t i = 0; i < k; i++)
+        owners[n + i] = NULL;
+    n += k;
+    if (n == 0)
+        return;
+
+    SpiDevice::Lock bus(_spi); // One batch per frame
+    if (_clearPending)
+    {
+        _tft.fillScreen(Colors::BACKGROUND_COLOR);
+        _bytesPushed += _tft.width() * _tft.height() * 2;
+        _clearPending = false;
+    }
+    for (uint8_t i = 0; i < n; i++)
+        _repaint(areas[i], owners[i]);
+    for (Widget *w : _widgets)
+        w->clean();
+    _anim.clean();
+    _frames++;
+}
+
+// Draws every widget overlapping an area back to front, then the effect overlays, off-screen
+// in the owner's canvas when it has one, else on the panel clipped to the area
+void UI::_repaint(const Region &area, Widget *owner)
+{
+    if (_dma)
+        _tft.dmaWait(); // Don't draw into a buffer that is still going out
+    _bytesPushed += area.w * area.h * 2;
+
+    uint16_t cover;
+    if (_anim.covers(area, cover)) // Nothing beneath shows
+    {
+        _tft.fillRect(area.x, area.y, area.w, area.h, cover);
+        return;
+    }
+
+    TFT_eSprite *canvas = owner ? owner->canvas(area) : NULL;
+    if (canvas)
+        canvas->fillSprite(Colors::BACKGROUND_COLOR);
     else
+        _tft.fillRect(area.x, area.y, area.w, area.h, Colors::BACKGROUND_COLOR);
+
+    TFT_eSPI &gfx = canvas ? *canvas : _tft;
+    int16_t dx = canvas ? -area.x : 0; // Screen to canvas coordinates
+    int16_t dy = canvas ? -area.y : 0;
+    for (Widget *w : _widgets)
     {
-        _tft.drawString("   Alarm not set", 314, 232);
+        if (!w->isVisible() || !w->bounds().intersects(area))
+            continue;
+        // Keeps shifted content inside the widget
+        Region clip = w->bounds().clipTo(area);
+        gfx.setViewport(clip.x + dx, clip.y + dy, clip.w, clip.h, false);
+        w->draw(gfx, w->bounds().x + w->offsetX() + dx, w->bounds().y + w->offsetY() + dy, clip);
     }
+    gfx.setViewport(area.x + dx, area.y + dy, area.w, area.h, false);
+    _anim.draw(gfx, dx, dy, area);
+    gfx.resetViewport();
+
+    if (canvas)
+        _push(*canvas, area);
+}
 
-    _tft.setTextDatum(TL_DATUM);
+// Starts a sprite push, by DMA it runs on while the next area is rendered
+void UI::_push(TFT_eSprite &sprite, const Region &area)
+{
+    if (_dma)
+        _tft.pushImageDMA(area.x, area.y, area.w, area.h, (uint16_t *)sprite.getPointer());
+    else
+        sprite.pushSprite(area.x, area.y);
 }
 
-void UI::handleClockButtonIn()
+// Both ways on the panel where the time is, the next frame puts the real time back
+void UI::_runBenchmark(uint16_t runs)
 {
-    ButtonState s = _btn.getState();
+    using namespace WidgetConfig;
+
+    GlyphCache &glyphs = _timeWidget.glyphs();
+    const Region &at = _timeWidget.bounds();
+    DateTime now = _tk.time();
+    char text[TIME_CELLS + 1];
+    snprintf(text, sizeof(text), "%02d:%02d", now.hour(), now.minute());
 
-    if (s.btn1.pressed)
     {
+        SpiDevice::Lock bus(_spi);
+        if (_dma)
+            _tft.dmaWait();
+
+        _tft.setTextColor(Colors::TEXT_COLOR, Colors::BACKGROUND_COLOR);
+        _tft.setTextSize(TIME_SIZE);
+        _tft.setTextDatum(TL_DATUM);
+        uint32_t start = micros();
+        for (uint16_t r = 0; r < runs; r++)
+            _tft.drawString(text, at.x, at.y, TIME_FONT);
+        _bench.fontUs = (micros() - start) / runs;
+        _tft.setTextSize(1);
+
+        start = micros();
+        for (uint16_t r = 0; r < runs && glyphs.ready(); r++)
+        {
+            int16_t x = at.x;
+            for (const char *c = text; *c; c++)
+            {
+                glyphs.blit(x, at.y, *c);
+                x += glyphs.width(*c);
+            }
+        }
+        _bench.cachedUs = glyphs.ready() ? (micros() - start) / runs : 0;
     }
-    if (s.btn1.pressed)
+    _bench.runs = runs;
+    _bench.cacheBytes = glyphs.bytes();
+
+    _timeWidget.invalidate();
+    xSemaphoreGive(_benchDone);
+}
+
+void UI::_drawLost(const DateTime &time)
+{
+    _tft.fillScreen(Colors::BACKGROUND_COLOR);
+    _tft.setTextSize(2);
+    _tft.setCursor(8, 8);
+    _tft.printf("Timestamp %02d:%02d:%02d %02d/%02d/%04d", time.hour(), time.minute(), time.second(), time.month(), time.day(), time.year());
+    _drawCenteredString("How did we get here?", TFT_YELLOW, Colors::BACKGROUND_COLOR, 2, 2);
+}
+
+void UI::_drawStartupStatus(const StartupStatus &s)
+{
+    _tft.setTextSize(1);
+    _tft.setTextColor(Colors::TEXT_COLOR);
+
+    _tft.println("----------------------------------------");
+    _tft.println("Board status:\n");
+
+    _tft.print("RTC ");
+    _tft.println(s.rtcOK ? "OK" : "FAIL");
+
+    if (s.rtcLostPower)
     {
+        _tft.setTextColor(TFT_YELLOW);
+        _tft.println("RTC experienced a power loss since last boot.");
+        _tft.setTextColor(Colors::TEXT_COLOR);
     }
-    if (s.btn1.pressed)
+
+    _tft.print("DFPlayer ");
+    _tft.println(s.playerOK ? "OK" : "FAIL");
+
+    _tft.print("RFID ");
+    _tft.println(s.rfidOK ? "OK" : "FAIL");
+
+    if (s.rtcOK && s.playerOK && s.rfidOK)
     {
+        _tft.setTextColor(TFT_GREEN);
+        _tft.println("\nAll hardware components responding.");
+        _tft.setTextColor(Colors::TEXT_COLOR);
     }
-    if (s.btn1.pressed)
+    else
     {
+        _tft.setTextColor(TFT_RED);
+        _tft.println("\nWarning: a hardware component is not responding.");
+        _tft.println("Clock functions may not work as intended.");
+        _tft.setTextColor(Colors::TEXT_COLOR);
     }
+    _tft.println("\nSystem check complete.");
 }
-//==================== Helpers ====================
 
 // Draws given string centered on the display
-void UI::drawCenteredString(const char text[],
-                            uint16_t textColor,
-                            uint16_t bgColor,
-                            uint8_t font,
-                            uint8_t size)
+void UI::_drawCenteredString(const char text[],
+                             uint16_t textColor,
+                             uint16_t bgColor,
+                             uint8_t font,
+                             uint8_t size)
 {
     _tft.setTextColor(textColor, bgColor);
     _tft.setTextDatum(MC_DATUM);
@@ -294,17 +650,13 @@ void UI::drawCenteredString(const char text[],
     _tft.setTextDatum(TL_DATUM); // Reset to default datum
 }
 
-// Flashes screen with color for set duration.
-void UI::flashScreen(uint16_t flashColor, int flashDuration)
-{
-
-    _tft.fillScreen(flashColor);
-    delay(flashDuration);
-    drawClockScreen(_tk.time(), _net.currentWeather);
-}
-
 //==================== Callbacks ====================
 void UI::setAlarmDataCallback(AlarmDataCallback cb)
 {
     _alarmDataCb = cb;
-}
\ No newline at end of file
+}
+
+void UI::setStatusDataCallback(StatusDataCallback cb)
+{
+    _statusDataCb = cb;
+}
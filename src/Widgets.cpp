@@ -0,0 +1,349 @@
+#include "Widgets.h"
+
+using namespace WidgetConfig;
+
+//==================== Region ====================
+
+Region Region::clipTo(const Region &o) const
+{
+    int16_t l = x > o.x ? x : o.x;
+    int16_t t = y > o.y ? y : o.y;
+    int16_t r = x + w < o.x + o.w ? x + w : o.x + o.w;
+    int16_t b = y + h < o.y + o.h ? y + h : o.y + o.h;
+    return {l, t, (int16_t)(r - l), (int16_t)(b - t)};
+}
+
+Region Region::merge(const Region &o) const
+{
+    int16_t l = x < o.x ? x : o.x;
+    int16_t t = y < o.y ? y : o.y;
+    int16_t r = x + w > o.x + o.w ? x + w : o.x + o.w;
+    int16_t b = y + h > o.y + o.h ? y + h : o.y + o.h;
+    return {l, t, (int16_t)(r - l), (int16_t)(b - t)};
+}
+
+//==================== Widget ====================
+
+// Constructor
+Widget::Widget(TFT_eSPI &tft, const Region &bounds)
+    : _canvas(&tft), _bounds(bounds), _dirty(true), _offsetX(0), _offsetY(0), _visible(true)
+{
+}
+
+bool Widget::begin()
+{
+    return _canvas.createSprite(_bounds.w, _bounds.h) != NULL;
+}
+
+void Widget::setOffset(int16_t dx, int16_t dy)
+{
+    if (dx == _offsetX && dy == _offsetY)
+        return;
+    _offsetX = dx;
+    _offsetY = dy;
+    invalidate();
+}
+
+void Widget::setVisible(bool visible)
+{
+    if (visible == _visible)
+        return;
+    _visible = visible;
+    invalidate();
+}
+
+uint8_t Widget::damage(Region *out, uint8_t max) const
+{
+    if (!_dirty || max == 0)
+        return 0;
+    out[0] = _bounds;
+    return 1;
+}
+
+TFT_eSprite *Widget::canvas(const Region &area)
+{
+    bool fits = area.w == _bounds.w && area.h == _bounds.h;
+    return fits && _canvas.created() ? &_canvas : NULL;
+}
+
+//==================== TimeWidget ====================
+
+// Constructor
+TimeWidget::TimeWidget(TFT_eSPI &tft)
+    : Widget(tft, {0, 0, 0, 0}), _tft(tft), _digitCell(&tft), _colonCell(&tft), _glyphs(tft), _cellX(), _cellW(), _shown()
+{
+    strcpy(_text, "--:--");
+}
+
+// Cells laid out like the centered "HH:MM" string
+bool TimeWidget::begin()
+{
+    _tft.setTextSize(TIME_SIZE);
+    int16_t digitW = _tft.textWidth("8", TIME_FONT);
+    int16_t colonW = _tft.textWidth(":", TIME_FONT);
+    int16_t h = _tft.fontHeight(TIME_FONT);
+    _tft.setTextSize(1);
+
+    int16_t w = (TIME_CELLS - 1) * digitW + colonW;
+    _bounds = {(int16_t)((_tft.width() - w) / 2), (int16_t)((_tft.height() - h) / 2), w, h};
+
+    int16_t x = 0;
+    for (uint8_t i = 0; i < TIME_CELLS; i++)
+    {
+        _cellX[i] = x;
+        _cellW[i] = i == COLON_CELL ? colonW : digitW;
+        x += _cellW[i];
+    }
+
+    // Without the cache the font still draws
+    _glyphs.build(TIME_FONT, TIME_SIZE, Colors::TEXT_COLOR, Colors::BACKGROUND_COLOR);
+
+    return _digitCell.createSprite(digitW, h) && _colonCell.createSprite(colonW, h);
+}
+
+void TimeWidget::set(uint8_t hour, uint8_t minute, bool colon)
+{
+    char text[TIME_CELLS + 1];
+    snprintf(text, sizeof(text), colon ? "%02d:%02d" : "%02d %02d", hour, minute);
+    if (strcmp(text, _text) != 0)
+    {
+        strcpy(_text, text);
+        _dirty = true;
+    }
+}
+
+void TimeWidget::invalidate()
+{
+    memset(_shown, 0, sizeof(_shown));
+    _dirty = true;
+}
+
+// Only the cells whose glyph changed
+uint8_t TimeWidget::damage(Region *out, uint8_t max) const
+{
+    if (!_dirty)
+        return 0;
+    uint8_t n = 0;
+    for (uint8_t i = 0; i < TIME_CELLS && n < max; i++)
+        if (_text[i] != _shown[i])
+            out[n++] = _cell(i);
+    return n;
+}
+
+void TimeWidget::clean()
+{
+    memcpy(_shown, _text, sizeof(_shown));
+    _dirty = false;
+}
+
+TFT_eSprite *TimeWidget::canvas(const Region &area)
+{
+    TFT_eSprite *cell = area.w == _cellW[COLON_CELL] ? &_colonCell : &_digitCell;
+    bool fits = area.w == cell->width() && area.h == cell->height();
+    return fits && cell->created() ? cell : NULL;
+}
+
+void TimeWidget::draw(TFT_eSPI &gfx, int16_t ox, int16_t oy, const Region &clip)
+{
+    // No-op unless the theme or size changed
+    bool cached = _glyphs.build(TIME_FONT, TIME_SIZE, Colors::TEXT_COLOR, Colors::BACKGROUND_COLOR);
+    bool inCell = &gfx == &_digitCell || &gfx == &_colonCell;
+
+    gfx.setTextColor(Colors::TEXT_COLOR, Colors::BACKGROUND_COLOR);
+    gfx.setTextSize(TIME_SIZE);
+    gfx.setTextDatum(TL_DATUM);
+
+    for (uint8_t i = 0; i < TIME_CELLS; i++)
+    {
+        Region cell = _cell(i);
+        cell.x += _offsetX;
+        cell.y += _offsetY;
+        if (!cell.intersects(clip))
+            continue;
+
+        // Whole cached glyphs are copied, only partly shown ones (sliding) go through the font
+        int16_t x = ox + _cellX[i];
+        if (cached && clip.contains(cell) && (inCell || &gfx == &_tft))
+        {
+            if (inCell)
+                _glyphs.blit(static_cast<TFT_eSprite &>(gfx), x, oy, _text[i]);
+            else
+                _glyphs.blit(x, oy, _text[i]);
+            continue;
+        }
+        if (_text[i] == ' ')
+            continue;
+        char glyph[2] = {_text[i], '\0'};
+        gfx.drawString(glyph, x, oy, TIME_FONT);
+    }
+    gfx.setTextSize(1);
+}
+
+Region TimeWidget::_cell(uint8_t i) const
+{
+    return {(int16_t)(_bounds.x + _cellX[i]), _bounds.y, _cellW[i], _bounds.h};
+}
+
+//==================== DateWidget ====================
+
+// Constructor
+DateWidget::DateWidget(TFT_eSPI &tft)
+    : Widget(tft, DATE_REGION)
+{
+    _text[0] = '\0';
+}
+
+void DateWidget::set(const DateTime &date)
+{
+    char text[sizeof(_text)];
+    snprintf(text, sizeof(text), "%02d/%02d/%04d", date.month(), date.day(), date.year());
+    if (strcmp(text, _text) != 0)
+    {
+        strcpy(_text, text);
+        _dirty = true;
+    }
+}
+
+void DateWidget::draw(TFT_eSPI &gfx, int16_t ox, int16_t oy, const Region &clip)
+{
+    gfx.setTextColor(Colors::TEXT_COLOR, Colors::BACKGROUND_COLOR);
+    gfx.setTextFont(1);
+    gfx.setTextSize(1);
+    gfx.setCursor(ox, oy);
+    gfx.print(_text);
+}
+
+//==================== WeatherWidget ====================
+
+// Constructor
+WeatherWidget::WeatherWidget(TFT_eSPI &tft)
+    : Widget(tft, WEATHER_REGION), _weather()
+{
+}
+
+// Only what is shown counts as a change
+void WeatherWidget::set(const WeatherData &weather)
+{
+    bool same = weather.valid == _weather.valid &&
+                (int)weather.temperature == (int)_weather.temperature &&
+                (int)weather.tempMax == (int)_weather.tempMax &&
+                (int)weather.tempMin == (int)_weather.tempMin &&
+                strcmp(weather.description, _weather.description) == 0;
+    _weather = weather;
+    if (!same)
+        _dirty = true;
+}
+
+void WeatherWidget::draw(TFT_eSPI &gfx, int16_t ox, int16_t oy, const Region &clip)
+{
+    gfx.setTextColor(Colors::TEXT_COLOR, Colors::BACKGROUND_COLOR);
+    gfx.setTextFont(1);
+
+    if (!_weather.valid)
+    {
+        gfx.setTextSize(1);
+        gfx.setCursor(ox + 2, oy + 20);
+        gfx.print("Weather Unavailable");
+        return;
+    }
+
+    int16_t x = ox + 2;
+    int16_t y = oy;
+
+    // current temp
+    gfx.setTextSize(2);
+    gfx.setCursor(x, y);
+
+    char tempBuf[8];
+    snprintf(tempBuf, sizeof(tempBuf), "%d", (int)_weather.temperature);
+    gfx.print(tempBuf);
+
+    // Measure printed temp width
+    int16_t tempWidth = gfx.textWidth(tempBuf);
+
+    // weather conditions and farenheit marker
+    gfx.setTextSize(1);
+    gfx.setCursor(x + tempWidth + 2, y + 6); // +6 aligns baselines nicely
+
+    char buf[32];
+    snprintf(buf, sizeof(buf), "F | H%d | L%d", (int)_weather.tempMax, (int)_weather.tempMin);
+    gfx.print(buf);
+
+    // hi/low temps
+    gfx.setCursor(x, y + 20);
+    gfx.print(_weather.description);
+}
+
+//==================== AlarmWidget ====================
+
+// Constructor
+AlarmWidget::AlarmWidget(TFT_eSPI &tft)
+    : Widget(tft, ALARM_REGION), _alarm()
+{
+}
+
+void AlarmWidget::set(const AlarmDisplayData &alarm)
+{
+    if (memcmp(&alarm, &_alarm, sizeof(alarm)) != 0)
+    {
+        _alarm = alarm;
+        _dirty = true;
+    }
+}
+
+void AlarmWidget::draw(TFT_eSPI &gfx, int16_t ox, int16_t oy, const Region &clip)
+{
+    gfx.setTextColor(Colors::TEXT_COLOR, Colors::BACKGROUND_COLOR);
+    gfx.setTextFont(1);
+    gfx.setTextSize(1);
+    gfx.setTextDatum(BR_DATUM);
+
+    int16_t right = ox + _bounds.w;
+    int16_t bottom = oy + _bounds.h;
+    if (_alarm.enabled)
+    {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "Alarm: %02d:%02d %s",
+                 _alarm.hour, _alarm.minute,
+                 _alarm.ringing ? "RINGING" : "SET");
+        gfx.drawString(buf, right, bottom);
+    }
+    else
+    {
+        gfx.drawString("Alarm not set", right, bottom);
+    }
+
+    gfx.setTextDatum(TL_DATUM);
+}
+
+//==================== StatusWidget ====================
+
+// Constructor
+StatusWidget::StatusWidget(TFT_eSPI &tft)
+    : Widget(tft, STATUS_REGION), _status()
+{
+}
+
+void StatusWidget::set(const StatusData &status)
+{
+    if (status.wifi != _status.wifi || status.enrolling != _status.enrolling)
+    {
+        _status = status;
+        _dirty = true;
+    }
+}
+
+void StatusWidget::draw(TFT_eSPI &gfx, int16_t ox, int16_t oy, const Region &clip)
+{
+    char buf[20];
+    snprintf(buf, sizeof(buf), "%s%s", _status.enrolling ? "SCAN CARD " : "", _status.wifi ? "WiFi" : "");
+    if (!buf[0])
+        return;
+
+    gfx.setTextFont(1);
+    gfx.setTextSize(1);
+    gfx.setTextDatum(TR_DATUM);
+    gfx.setTextColor(_status.enrolling ? TFT_YELLOW : Colors::TEXT_COLOR, Colors::BACKGROUND_COLOR);
+    gfx.drawString(buf, ox + _bounds.w, oy);
+    gfx.setTextDatum(TL_DATUM);
+}
@@ -1,19 +1,27 @@
 #include "AlarmSystem.h"
 #include "AppController.h"
+#include "AudioPlayer.h"
 #include "BrightnessController.h"
 #include "Buttons.h"
+#include "CardRegistry.h"
 #include "CommandInterface.h"
 #include "Config.h"
+#include "DisplayPower.h"
+#include "Gestures.h"
 #include "Log.h"
 #include "NetworkManager.h"
 #include "RFIDHandler.h"
+#include "Settings.h"
+#include "SpiBus.h"
 #include "Timekeeper.h"
+#include "TrackCatalog.h"
 #include "UI.h"
 #include <DFRobotDFPlayerMini.h> // DFPlayer Mini core library
 #include <HardwareSerial.h>      // Serial comms for DFPlayer Mini
 #include <MFRC522.h>             // RFID core library
 #include <RTClib.h>              // DS3231 RTC core library
 #include <TFT_eSPI.h>            // ST7789 TFT core library
+#include <WiFi.h>                // Connection state for the status widget
 #include <esp_task_wdt.h>        // For freeRTOS task implementation
 
 //==========
@@ -26,18 +34,29 @@ MFRC522 rfid(Pins::RFID_CS_PIN, Pins::RFID_RST_PIN);
 RTC_DS3231 rtc;
 TFT_eSPI tft = TFT_eSPI();
 
+// Shared VSPI bus
+SpiBus spiBus;
+SpiDevice tftSpi(spiBus, "tft", SpiBusConfig::TFT_HZ, SPI_MODE0);
+SpiDevice rfidSpi(spiBus, "rfid", SpiBusConfig::RFID_HZ, SPI_MODE0);
+
 // Logic objects
 Buttons btn(Pins::BUTTON_1_PIN, Pins::BUTTON_2_PIN, Pins::BUTTON_3_PIN, Pins::BUTTON_4_PIN); // TODO: add default pins into constructor
+Gestures gestures;
 BrightnessController brightness;                                     // uses default pins from Config.h
 Timekeeper timekeeper(rtc);
 Log LOG(timekeeper);
+Settings SETTINGS;
 NetworkManager networkManager(rtc);
-RFIDHandler rfidHandler(rfid);
-AlarmSystem alarmSystem(rtc, timekeeper, player);
-UI ui(tft, btn, timekeeper, networkManager);
-AppController appController(btn, rfidHandler, alarmSystem, ui, player);
+RFIDHandler rfidHandler(rfid, rfidSpi);
+CardRegistry cards;
+AudioPlayer audio(player);
+TrackCatalog trackCatalog(audio);
+AlarmSystem alarmSystem(rtc, timekeeper, audio, trackCatalog);
+UI ui(tft, tftSpi, btn, timekeeper, networkManager);
+DisplayPower displayPower(tft, tftSpi, brightness, timekeeper);
+AppController appController(btn, gestures, rfidHandler, alarmSystem, ui, displayPower, brightness, audio, trackCatalog, cards);
 
-CommandInterface commandInterface(player, timekeeper, ui, networkManager, alarmSystem);
+CommandInterface commandInterface(audio, trackCatalog, timekeeper, ui, networkManager, alarmSystem, brightness, cards, spiBus);
 
 //========== INITIALIZATION ==========
 struct HardwareStatus
@@ -50,7 +69,7 @@ struct HardwareStatus
 
 void setupSys()
 {
-    // uSet.load(); // Load user settings from EEPROM (TODO: make this functional)
+    SETTINGS.begin(); // Load user settings from flash
 
     // Watchdog
     esp_task_wdt_init(30, true);
@@ -61,17 +80,28 @@ HardwareStatus setupBoard()
 {
     HardwareStatus hs;
 
+    //===== SPI bus init =====
+    spiBus.begin();
+    tftSpi.setBatch([]()
+                    { tft.startWrite(); }, // Keeps CS low and the bus set up for a whole redraw
+                    []()
+                    { tft.endWrite(); });
+
     //===== TFT init =====
     tft.init();
-    tft.fillScreen(Colors::BACKGROUND_COLOR);
+    {
+        SpiDevice::Lock bus(tftSpi);
+        tft.fillScreen(Colors::BACKGROUND_COLOR);
+    }
 
     //===== Brightness controller init =====
     // Must come after tft.init() so the PWM pin doesn't fight the TFT setup
     brightness.begin();
 
     //===== Buttons init =====
-    btn.begin();  // creates Buttons mutex and sets pinMode
-    btn.update(); // takes an initial reading so getState() is valid
+    btn.begin();  // creates Buttons mutex, reads initial levels and attaches pin interrupts
+    btn.update(); // publishes the initial state so getState() is valid
+    gestures.begin();
 
     //===== RTC init =====
     if (!rtc.begin())
@@ -92,18 +122,22 @@ HardwareStatus setupBoard()
     mySoftwareSerial.begin(9600, SERIAL_8N1, 16, 17); // RX=16, TX=17
     delay(1000);                                      // Wait for .begin() to succeed
 
-    if (!player.begin(mySoftwareSerial))
+    if (!audio.begin(mySoftwareSerial)) // starts audio task
         hs.playerOK = false;
-    else
-        player.volume(PLAYER_VOLUME);
+    audio.volume(SETTINGS.get(Setting::Volume));
 
     //===== RFID init =====
     SPI.begin();
-    rfid.PCD_Init();
-
-    byte version = rfid.PCD_ReadRegister(MFRC522::VersionReg);
+    byte version;
+    {
+        SpiDevice::Lock bus(rfidSpi);
+        rfid.PCD_Init();
+        version = rfid.PCD_ReadRegister(MFRC522::VersionReg);
+    }
     if (version == 0x00 || version == 0xFF)
         hs.rfidOK = false;
+    else
+        rfidHandler.begin(); // IRQ card detection, or polling if the IRQ line is silent
 
     //===== NetworkManager init =====
     networkManager.begin(); // creates mutex for network access
@@ -172,21 +206,19 @@ void waitForUserContinue()
     unsigned long lastAction = millis();
     const unsigned long interval = 1000;
 
-    tft.setTextColor(TFT_YELLOW);
-    tft.print("Press any button to continue");
+    ui.print("Press any button to continue", TFT_YELLOW);
 
     while (!btn.getState().anyPressed())
     {
         unsigned long now = millis();
         if (now - lastAction >= interval)
         {
-            tft.print(".");
+            ui.print(".", TFT_YELLOW);
             lastAction = now;
         }
         btn.update();
         delay(10);
     }
-    tft.setTextColor(Colors::TEXT_COLOR);
 }
 
 // FreeRTOS tasks funciton definitions
@@ -206,38 +238,93 @@ void setup()
 
     LOG.begin();
     logResetReason();
+    cards.begin();
+    commandInterface.begin();
+
+    if (hs.playerOK)
+        trackCatalog.begin(); // needs audio task, skips the scan if the card is unchanged
 
     alarmSystem.begin();
     ui.begin();
 
     //========== Callback registration ==========
-    alarmSystem.onAlarmEvent([&]()
-                             { ui.updateAlarmDisplay(); });
+    // RFID reader runs at full rate only around alarms
+    auto updateRfidSchedule = []()
+    {
+        AlarmTime a;
+        DateTime when;
+        bool scheduled = alarmSystem.getNextAlarm(a, when);
+        int32_t secs = scheduled ? (when - timekeeper.time()).totalseconds() : 0;
+        rfidHandler.setAlarmState(alarmSystem.isRinging(), scheduled, secs > 0 ? secs * 1000UL : 0);
+    };
+    SETTINGS.onChange(Setting::RfidIdleMs, [updateRfidSchedule](int32_t)
+                      { updateRfidSchedule(); });
+    updateRfidSchedule();
+
+    alarmSystem.onAlarmEvent([updateRfidSchedule]()
+                             {
+            displayPower.hold(alarmSystem.isRinging()); // Ringing alarm keeps the display on
+            updateRfidSchedule();
+            ui.updateAlarmDisplay(); });
+
+    displayPower.onStateChange([&](PowerState state)
+                               { ui.setPowerState(state); });
+
+    SETTINGS.onChange(Setting::WiFiPersistent, [&](int32_t on)
+                      { networkManager.setWiFiPersistent(on); });
+    networkManager.setWiFiPersistent(SETTINGS.getBool(Setting::WiFiPersistent));
+
+    SETTINGS.onChange(Setting::Volume, [&](int32_t vol)
+                      {
+            if (!alarmSystem.isRinging())
+                audio.volume(vol); });
+
+    // Gesture timings follow the settings
+    auto applyGestureTimings = [&](int32_t)
+    {
+        GestureTimings t = gestures.getTimings();
+        t.longPressMs = SETTINGS.get(Setting::LongPressMs);
+        t.doubleClickMs = SETTINGS.get(Setting::DoubleClickMs);
+        gestures.setTimings(t);
+    };
+    SETTINGS.onChange(Setting::LongPressMs, applyGestureTimings);
+    SETTINGS.onChange(Setting::DoubleClickMs, applyGestureTimings);
+    applyGestureTimings(0);
+
+    alarmSystem.onWakeRamp([&](uint32_t durationMs)
+                           {
+            displayPower.hold(true);
+            brightness.rampTo(BrightnessConfig::BRIGHTNESS_MAX, durationMs); });
 
     ui.setAlarmDataCallback([&]() -> UI::AlarmDisplayData
                             {
-            AlarmTime a = alarmSystem.getAlarm();
-            return { a.hour, a.minute, a.enabled, alarmSystem.isRinging() }; });
+            AlarmTime a;
+            DateTime when;
+            bool scheduled = alarmSystem.getNextAlarm(a, when);
+            return { when.hour(), when.minute(), scheduled, alarmSystem.isRinging() }; });
 
-    rfidHandler.onRFIDEvent([&](const char *uid)
-                            {
-            if (alarmSystem.isRinging())
-            {
-                alarmSystem.dismissAlarm();
-                ui.flashScreen(TFT_GREEN);
-            } });
+    ui.setStatusDataCallback([]() -> StatusData
+                             { return {WiFi.status() == WL_CONNECTED, cards.isEnrolling()}; });
+
+    rfidHandler.onRFIDEvent([](const uint8_t *uid, uint8_t len)
+                            { appController.handleCardIn(uid, len); });
+
+    appController.onCardCommand([](const char *macro)
+                                { commandInterface.handleCardIn(macro); });
 
     // Display hardware notification if available
     if (!ui.displayStartupStatus(hs.rtcOK, hs.rtcLostPower, hs.playerOK, hs.rfidOK))
         waitForUserContinue();
     else
         delay(3000);
+    btn.clearEvents(); // Boot screen presses are not clock input
 
     xTaskCreatePinnedToCore(timeSyncTask, "TimeSyncTask", 4096, NULL, 1, NULL, 1);
     xTaskCreatePinnedToCore(weatherTask, "WeatherTask", 4096, NULL, 1, NULL, 1);
     xTaskCreatePinnedToCore(blynkTask, "BlynkTask", 16384, NULL, 1, NULL, 1);
 
     ui.setState(State::Clock);
+    displayPower.begin(); // Inactivity counts from here
 }
 
 void loop()
@@ -248,13 +335,13 @@ void loop()
     rfidHandler.poll();
 
     alarmSystem.run();
+    displayPower.run();
     ui.run();
 
     appController.handleIn();
 
-    brightness.updateAmbient();
-
     commandInterface.handleSerialIn();
+    SETTINGS.run();
 
     esp_task_wdt_reset();
     delay(10);